@@ -5,147 +5,2436 @@
  */
 
 
+/********************* Host Simulation *******************************/
+
+/**
+ * Defining HARDFAULT_HOST_SIM builds the handler for a Linux host instead of the device.
+ * The device registers and functions used by the handler are replaced by the shims below, on the state of host/hostSim.c,
+ * the storage backends and the DMA by the simulated devices of host/hostSim_devices.c
+ * and the HardFault_Handler by hostSim_capture (end of this file), which host/hostSim.c calls on a fabricated exception frame.
+ * The simulated RAM is mapped at HOSTSIM_RAM_BASE so device addresses keep fitting in 32 bits,
+ * other memory given to the handler (registered regions, code) must be in it or in a build linked with -no-pie.
+ * host/test.c runs the capture over a set of faults for several configurations: make -C host test
+ */
+#ifdef HARDFAULT_HOST_SIM
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+#include "host/hostSim.h"
+
+#ifndef MIN
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#endif
+
+#define SCB (&hostSim_SCB)
+#define FPU (&hostSim_FPU)
+#define FPU_FPCCR_LSPACT_Msk HOSTSIM_FPCCR_LSPACT
+
+static inline uint32_t __get_PSP(void)
+{
+	return hostSim_PSP;
+}
+
+static inline uint32_t __get_FPSCR(void)
+{
+	return hostSim_FPSCR;
+}
+
+static inline uint32_t __get_IPSR(void)
+{
+	return hostSim_IPSR;
+}
+
+static inline void NVIC_SystemReset(void)
+{
+	hostSim_reset();
+}
+#endif
+
+#include "hardFault_handler.h"
+
+
 /********************* HardFault Handler *******************************/
 
 /**
- * Saving the data to a location on the RAM that isn't included in the linker file and will not be erased by reset
- * Another option is to save the data to the internal flash
+ * The storage the dump is saved to, selected at compile time
+ * RAM            - a location on the RAM that isn't included in the linker file and will not be erased by reset
+ * INTERNAL_FLASH - pages of the internal flash, programmed in units of FLASH_PROGRAM_UNIT
+ * SPI_NOR        - an external SPI/QSPI NOR flash
+ * FRAM           - an external FRAM, written in place without erasing
+ * Only the selected backend is compiled, so the handler calls it directly without any dispatch.
+ * Except for RAM, the device specific methods of the backend (flash_xxx, spiNor_xxx, fram_xxx) need to be implemented.
+ * Defining HARDFAULT_HOST_SIM replaces them with a simulation of the device on a host array.
+ */
+#define HARDFAULT_STORAGE_RAM 0
+#define HARDFAULT_STORAGE_INTERNAL_FLASH 1
+#define HARDFAULT_STORAGE_SPI_NOR 2
+#define HARDFAULT_STORAGE_FRAM 3
+
+#ifndef HARDFAULT_STORAGE_BACKEND
+#define HARDFAULT_STORAGE_BACKEND HARDFAULT_STORAGE_RAM
+#endif
+
+#if HARDFAULT_STORAGE_BACKEND == HARDFAULT_STORAGE_RAM
+#ifndef ERROR_HANDELING_MEMORY_ADDRESS
+#define ERROR_HANDELING_MEMORY_ADDRESS (PROG_RAM_END) // end of RAM allocated by the linker file
+#define ERROR_HANDELING_MEMORY_SIZE (RAM_END - PROG_RAM_END)
+#endif
+#elif !defined(ERROR_HANDELING_MEMORY_ADDRESS) || !defined(ERROR_HANDELING_MEMORY_SIZE)
+#error "ERROR_HANDELING_MEMORY_ADDRESS and ERROR_HANDELING_MEMORY_SIZE must be defined for the selected storage backend"
+#endif
+
+#define HARDFAULT_ALIGN_UP(value, align) ((((value) + (align) - 1) / (align)) * (align))
+
+// --------------------------------------------------------------------------------------
+
+/**
+ * Copy and fill routines for the fault path, which must not depend on the libc memcpy/memset:
+ * they may be the slow byte-wise variants or be corrupted themselves.
+ * The empty asm statement in their loops keeps the compiler from turning them back into memcpy/memset calls,
+ * whatever the compiler and its flags. The rest of the fault path avoids loops and zero filled aggregates that could
+ * become such calls, building this file with -fno-tree-loop-distribute-patterns (GCC) or -fno-builtin (clang) makes sure of it.
+ */
+#define FAULT_SAFE_LOOP() __asm volatile ("" : : : "memory")
+
+/**
+ * copy in 32 byte LDM/STM bursts when the source and destination are equally aligned,
+ * with byte copies for the unaligned head and tail
+ */
+static void prvFaultSafeCopy(void* destination, const void* source, uint32_t length)
+{
+	uint8_t* dst = destination;
+	const uint8_t* src = source;
+
+	if ((((uint32_t)(uintptr_t)dst ^ (uint32_t)(uintptr_t)src) & 3) == 0)
+	{
+		while (length > 0 && ((uint32_t)(uintptr_t)dst & 3) != 0)
+		{
+			*dst++ = *src++;
+			length--;
+			FAULT_SAFE_LOOP();
+		}
+#ifdef HARDFAULT_HOST_SIM
+		for (; length >= 32; length -= 32, dst += 32, src += 32)
+		{
+			for (uint32_t i = 0; i < 8; i++)
+				((uint32_t*)dst)[i] = ((const uint32_t*)src)[i];
+			FAULT_SAFE_LOOP();
+		}
+#else
+		/* not assembled or run yet: the tree has no target build, the host simulation runs the C loop above */
+		for (; length >= 32; length -= 32)
+		{
+			__ASM volatile
+			(
+			    " ldmia %[src]!, {r3-r6, r8, r10-r12}   \n"
+			    " stmia %[dst]!, {r3-r6, r8, r10-r12}   \n"
+			    : [src] "+r" (src), [dst] "+r" (dst)
+			    :
+			    : "r3", "r4", "r5", "r6", "r8", "r10", "r11", "r12", "memory"
+			);
+		}
+#endif
+		for (; length >= 4; length -= 4, dst += 4, src += 4)
+		{
+			*(uint32_t*)dst = *(const uint32_t*)src;
+			FAULT_SAFE_LOOP();
+		}
+	}
+
+	while (length-- > 0)
+	{
+		*dst++ = *src++;
+		FAULT_SAFE_LOOP();
+	}
+}
+
+static void prvFaultSafeFill(void* destination, uint8_t value, uint32_t length)
+{
+	uint8_t* dst = destination;
+	uint32_t word = value * 0x01010101u;
+
+	while (length > 0 && ((uint32_t)(uintptr_t)dst & 3) != 0)
+	{
+		*dst++ = value;
+		length--;
+		FAULT_SAFE_LOOP();
+	}
+	for (; length >= 4; length -= 4, dst += 4)
+	{
+		*(uint32_t*)dst = word;
+		FAULT_SAFE_LOOP();
+	}
+	while (length-- > 0)
+	{
+		*dst++ = value;
+		FAULT_SAFE_LOOP();
+	}
+}
+
+#ifdef HARDFAULT_HOST_SIM
+/**
+ * The simulated device, the reserved region is mapped to a host array
+ */
+static uint8_t hostSim_storageData[ERROR_HANDELING_MEMORY_SIZE];
+
+#define STORAGE_PTR(address) (&hostSim_storageData[(address) - ERROR_HANDELING_MEMORY_ADDRESS])
+#else
+#define STORAGE_PTR(address) ((uint8_t*)(address))
+#endif
+
+// --------------------------------------------------------------------------------------
+#if HARDFAULT_STORAGE_BACKEND == HARDFAULT_STORAGE_RAM
+
+#define HARDFAULT_STORAGE_ERASE_UNIT 1
+#define HARDFAULT_STORAGE_WRITE_UNIT 1
+#define HARDFAULT_STORAGE_NEEDS_ERASE 0
+#define HARDFAULT_STORAGE_MEMORY_MAPPED 1
+
+void memory_erase(uint32_t address, uint32_t length)
+{
+	prvFaultSafeFill((void*)STORAGE_PTR(address), 0, length);
+}
+
+void memory_write(uint32_t address, const void* data, uint32_t length)
+{
+	prvFaultSafeCopy((void*)STORAGE_PTR(address), data, length);
+}
+
+void memory_read(uint32_t address, void* data, uint32_t length)
+{
+	memcpy(data, (void*)STORAGE_PTR(address), length);
+}
+
+void memory_flush(void)
+{
+}
+
+// --------------------------------------------------------------------------------------
+#elif HARDFAULT_STORAGE_BACKEND == HARDFAULT_STORAGE_INTERNAL_FLASH
+
+/**
+ * FLASH_PAGE_SIZE    - the erase granularity, the reserved region must be aligned to it
+ * FLASH_PROGRAM_UNIT - the program granularity, each unit can be programmed only once after erase
+ * FLASH_CHUNK_SIZE   - the size of each of the two staging buffers, a multiple of FLASH_PROGRAM_UNIT
+ */
+#ifndef FLASH_PAGE_SIZE
+#define FLASH_PAGE_SIZE 2048
+#endif
+#ifndef FLASH_PROGRAM_UNIT
+#define FLASH_PROGRAM_UNIT 8
+#endif
+#ifndef FLASH_CHUNK_SIZE
+#define FLASH_CHUNK_SIZE 256
+#endif
+
+#if (FLASH_CHUNK_SIZE % FLASH_PROGRAM_UNIT) != 0
+#error "FLASH_CHUNK_SIZE must be a multiple of FLASH_PROGRAM_UNIT"
+#endif
+
+#define HARDFAULT_STORAGE_ERASE_UNIT FLASH_PAGE_SIZE
+#define HARDFAULT_STORAGE_WRITE_UNIT FLASH_PROGRAM_UNIT
+#define HARDFAULT_STORAGE_NEEDS_ERASE 1
+#define HARDFAULT_STORAGE_MEMORY_MAPPED 1
+
+/* device specific
+ * flash_programStart starts programming and returns without waiting for it to finish (e.g. using DMA or the flash
+ * controller's write buffer), address and length are multiples of FLASH_PROGRAM_UNIT.
+ * On parts where programming stalls the CPU, it can simply program synchronously and flash_waitReady do nothing. */
+void flash_erasePage(uint32_t pageAddress);
+void flash_programStart(uint32_t address, const void* data, uint32_t length);
+void flash_waitReady(void);
+
+/**
+ * Writes are staged into two chunk buffers: while one chunk is being programmed the next one is filled.
+ * Only the program units that were written to are programmed, so units that are skipped now can be programmed later.
+ * Writes that don't continue the previous write must start on a program unit boundary.
+ */
+static uint8_t flashChunk[2][FLASH_CHUNK_SIZE] __attribute__((aligned(4)));
+static uint8_t flashChunkIndex;   // the buffer being filled
+static uint32_t flashChunkAddress; // the flash address of the buffer being filled
+static uint32_t flashChunkStart;   // offset of the first byte written to the buffer
+static uint32_t flashChunkEnd;     // offset following the last byte written to the buffer
+static bool flashChunkPending;
+
+/**
+ * start programming the chunk being filled and switch to the other buffer
+ */
+static void prvFlashProgramChunk(void)
+{
+	if (!flashChunkPending)
+		return;
+
+	uint32_t start = flashChunkStart - (flashChunkStart % FLASH_PROGRAM_UNIT);
+	uint32_t end = HARDFAULT_ALIGN_UP(flashChunkEnd, FLASH_PROGRAM_UNIT);
+	/* the other buffer can't be reused before its programming is done */
+	flash_waitReady();
+	flash_programStart(flashChunkAddress + start, &flashChunk[flashChunkIndex][start], end - start);
+	flashChunkIndex ^= 1;
+	flashChunkPending = false;
+}
+
+void memory_flush(void)
+{
+	prvFlashProgramChunk();
+	flash_waitReady();
+}
+
+/**
+ * erases all the pages that overlap the given range
+ */
+void memory_erase(uint32_t address, uint32_t length)
+{
+	flash_waitReady();
+	for (uint32_t page = address - (address % FLASH_PAGE_SIZE); page < address + length; page += FLASH_PAGE_SIZE)
+		flash_erasePage(page);
+}
+
+void memory_write(uint32_t address, const void* data, uint32_t length)
+{
+	const uint8_t* src = data;
+	while (length > 0)
+	{
+		uint32_t chunkAddress = address - (address % FLASH_CHUNK_SIZE);
+		uint32_t offset = address - chunkAddress;
+		if (flashChunkPending && (chunkAddress != flashChunkAddress || offset != flashChunkEnd))
+			prvFlashProgramChunk();
+		if (!flashChunkPending)
+		{
+			prvFaultSafeFill(flashChunk[flashChunkIndex], 0xFF, FLASH_CHUNK_SIZE);
+			flashChunkAddress = chunkAddress;
+			flashChunkStart = offset;
+			flashChunkPending = true;
+		}
+
+		uint32_t chunk = MIN(length, FLASH_CHUNK_SIZE - offset);
+		prvFaultSafeCopy(&flashChunk[flashChunkIndex][offset], src, chunk);
+		flashChunkEnd = offset + chunk;
+		if (flashChunkEnd == FLASH_CHUNK_SIZE)
+			prvFlashProgramChunk();
+
+		address += chunk;
+		src += chunk;
+		length -= chunk;
+	}
+}
+
+void memory_read(uint32_t address, void* data, uint32_t length)
+{
+	memcpy(data, (void*)STORAGE_PTR(address), length); // the internal flash is memory mapped
+}
+
+// --------------------------------------------------------------------------------------
+#elif HARDFAULT_STORAGE_BACKEND == HARDFAULT_STORAGE_SPI_NOR
+
+/**
+ * SPI_NOR_SECTOR_SIZE - the erase granularity, the reserved region must be aligned to it
+ * SPI_NOR_PAGE_SIZE   - a single program command can't cross a page boundary
+ */
+#ifndef SPI_NOR_SECTOR_SIZE
+#define SPI_NOR_SECTOR_SIZE 4096
+#endif
+#ifndef SPI_NOR_PAGE_SIZE
+#define SPI_NOR_PAGE_SIZE 256
+#endif
+
+#define HARDFAULT_STORAGE_ERASE_UNIT SPI_NOR_SECTOR_SIZE
+#define HARDFAULT_STORAGE_WRITE_UNIT 1
+#define HARDFAULT_STORAGE_NEEDS_ERASE 1
+#define HARDFAULT_STORAGE_MEMORY_MAPPED 0
+
+/* device specific, must work with interrupts disabled (polling) */
+void spiNor_eraseSector(uint32_t sectorAddress);
+void spiNor_program(uint32_t address, const void* data, uint32_t length);
+void spiNor_read(uint32_t address, void* data, uint32_t length);
+
+/**
+ * erases all the sectors that overlap the given range
+ */
+void memory_erase(uint32_t address, uint32_t length)
+{
+	for (uint32_t sector = address - (address % SPI_NOR_SECTOR_SIZE); sector < address + length; sector += SPI_NOR_SECTOR_SIZE)
+		spiNor_eraseSector(sector);
+}
+
+void memory_write(uint32_t address, const void* data, uint32_t length)
+{
+	const uint8_t* src = data;
+	while (length > 0)
+	{
+		uint32_t chunk = MIN(length, SPI_NOR_PAGE_SIZE - (address % SPI_NOR_PAGE_SIZE));
+		spiNor_program(address, src, chunk);
+		address += chunk;
+		src += chunk;
+		length -= chunk;
+	}
+}
+
+void memory_read(uint32_t address, void* data, uint32_t length)
+{
+	spiNor_read(address, data, length);
+}
+
+void memory_flush(void)
+{
+}
+
+// --------------------------------------------------------------------------------------
+#elif HARDFAULT_STORAGE_BACKEND == HARDFAULT_STORAGE_FRAM
+
+#define HARDFAULT_STORAGE_ERASE_UNIT 1
+#define HARDFAULT_STORAGE_WRITE_UNIT 1
+#define HARDFAULT_STORAGE_NEEDS_ERASE 0
+#define HARDFAULT_STORAGE_MEMORY_MAPPED 0
+
+/* device specific, must work with interrupts disabled (polling) */
+void fram_write(uint32_t address, const void* data, uint32_t length);
+void fram_read(uint32_t address, void* data, uint32_t length);
+
+void memory_erase(uint32_t address, uint32_t length)
+{
+	static const uint8_t zeros[32] = {0};
+	while (length > 0)
+	{
+		uint32_t chunk = MIN(length, sizeof(zeros));
+		fram_write(address, zeros, chunk);
+		address += chunk;
+		length -= chunk;
+	}
+}
+
+void memory_write(uint32_t address, const void* data, uint32_t length)
+{
+	fram_write(address, data, length);
+}
+
+void memory_read(uint32_t address, void* data, uint32_t length)
+{
+	fram_read(address, data, length);
+}
+
+void memory_flush(void)
+{
+}
+
+#else
+#error "unknown HARDFAULT_STORAGE_BACKEND"
+#endif
+
+// --------------------------------------------------------------------------------------
+
+/**
+ * How the handler prepares the slot before saving the dump
+ * FULL        - erase the entire slot before writing
+ * INCREMENTAL - erase only the erase units that are about to be written, the rest of the slot is left untouched
+ * NONE        - don't erase, only invalidate the slot header. For memories that can be overwritten in place like RAM
+ * The default is INCREMENTAL for backends that must be erased before writing and NONE for the rest
+ */
+#define HARDFAULT_ERASE_FULL 0
+#define HARDFAULT_ERASE_INCREMENTAL 1
+#define HARDFAULT_ERASE_NONE 2
+
+#ifndef HARDFAULT_ERASE_MODE
+#if HARDFAULT_STORAGE_NEEDS_ERASE
+#define HARDFAULT_ERASE_MODE HARDFAULT_ERASE_INCREMENTAL
+#else
+#define HARDFAULT_ERASE_MODE HARDFAULT_ERASE_NONE
+#endif
+#endif
+
+#if HARDFAULT_ERASE_MODE == HARDFAULT_ERASE_NONE && HARDFAULT_STORAGE_NEEDS_ERASE
+#error "HARDFAULT_ERASE_NONE can't be used with a storage that needs erasing, programming can only clear bits"
+#endif
+
+/**
+ * The reserved region is divided into HARDFAULT_SLOT_COUNT slots, each holding one dump.
+ * Every dump gets the next sequence number and is saved to slot (sequence % HARDFAULT_SLOT_COUNT),
+ * so a new dump goes to a free slot or replaces the oldest one.
+ * The slot count must be a power of two so the slots keep rotating when the 32bit sequence number wraps.
+ * The slot size is rounded down to the erase unit of the backend.
+ */
+#ifndef HARDFAULT_SLOT_COUNT
+#define HARDFAULT_SLOT_COUNT 4
+#endif
+#if HARDFAULT_SLOT_COUNT == 0 || (HARDFAULT_SLOT_COUNT & (HARDFAULT_SLOT_COUNT - 1)) != 0
+#error "HARDFAULT_SLOT_COUNT must be a power of two"
+#endif
+#define HARDFAULT_SLOT_SIZE (((ERROR_HANDELING_MEMORY_SIZE / HARDFAULT_SLOT_COUNT) / HARDFAULT_STORAGE_ERASE_UNIT) * HARDFAULT_STORAGE_ERASE_UNIT)
+
+/**
+ * Compress the context stack with a run length encoding of 32bit words, so deeper stacks fit in a slot.
+ * Stacks are mostly made of runs of zeros and watermark words (0xA5A5A5A5), which are stored as two words and a count.
+ * Decode the stack with hardFault_decodeStack after reading the dump.
+ */
+#ifndef HARDFAULT_STACK_RLE
+#define HARDFAULT_STACK_RLE 0
+#endif
+
+/**
+ * Save the FPU registers when the violating context had an active FPU context (extended exception frame).
+ * S0-S15 and FPSCR are taken from the exception frame, or from the FPU itself if lazy stacking didn't save them yet.
+ * S16-S31 are never stacked by the hardware, HARDFAULT_CAPTURE_FPU_HIGH_REGISTERS saves them from the FPU as well.
+ */
+#ifndef HARDFAULT_CAPTURE_FPU
+#if defined(__FPU_USED) && (__FPU_USED == 1)
+#define HARDFAULT_CAPTURE_FPU 1
+#else
+#define HARDFAULT_CAPTURE_FPU 0
+#endif
+#endif
+#ifndef HARDFAULT_CAPTURE_FPU_HIGH_REGISTERS
+#define HARDFAULT_CAPTURE_FPU_HIGH_REGISTERS 0
+#endif
+
+/**
+ * Measure the cycles spent in each phase of the capture with the DWT cycle counter and save them in the dump header.
+ * On the host the counter is the simulated device time, so the phases add up to the simulated cycles of the capture.
+ */
+#ifndef HARDFAULT_PHASE_TIMING
+#define HARDFAULT_PHASE_TIMING 0
+#endif
+
+/**
+ * Copy the context stack with a memory to memory DMA channel, while the CPU computes the CRC of the stack.
+ * Only for the RAM backend, where the DMA can write the reserved region directly.
+ * The CPU copies the stack instead when the fault may involve the DMA controller (a precise bus fault
+ * address inside the peripheral space) or when the DMA reports an error.
+ */
+#ifndef HARDFAULT_STACK_DMA
+#define HARDFAULT_STACK_DMA 0
+#endif
+#if HARDFAULT_STACK_DMA && HARDFAULT_STORAGE_BACKEND != HARDFAULT_STORAGE_RAM
+#error "HARDFAULT_STACK_DMA requires the RAM storage backend"
+#endif
+#if HARDFAULT_STACK_DMA && HARDFAULT_STACK_RLE
+#error "HARDFAULT_STACK_DMA can't copy an encoded stack, disable HARDFAULT_STACK_RLE"
+#endif
+
+/**
+ * What to do when the stack doesn't fit in the space left in the slot
+ * CUT     - save the stack from the sp until the slot is full, the outermost frames are lost
+ * COMPACT - save the stack as is until only HARDFAULT_COMPACT_ADDRESS_BYTES are left in the slot, then in those only the
+ *           words of the rest that are return addresses (see HARDFAULT_BACKTRACE_SCAN, the code ranges must be set with
+ *           hardFault_setCodeRanges). At most HARDFAULT_SCAN_MAX_WORDS words of the rest are scanned.
+ *           This keeps the call chain of the outer frames, at the cost of their locals.
+ * SPLIT   - save a head window from the sp and a tail window of HARDFAULT_SPLIT_TAIL_BYTES at the stack base,
+ *           each with its original address, so both the fault site and the entry point of the task are kept.
+ */
+#define HARDFAULT_TRUNCATE_CUT 0
+#define HARDFAULT_TRUNCATE_COMPACT 1
+#define HARDFAULT_TRUNCATE_SPLIT 2
+
+#ifndef HARDFAULT_STACK_TRUNCATION
+#define HARDFAULT_STACK_TRUNCATION HARDFAULT_TRUNCATE_CUT
+#endif
+#ifndef HARDFAULT_COMPACT_ADDRESS_BYTES
+#define HARDFAULT_COMPACT_ADDRESS_BYTES 256
+#endif
+#ifndef HARDFAULT_SPLIT_TAIL_BYTES
+#define HARDFAULT_SPLIT_TAIL_BYTES 256
+#endif
+#if HARDFAULT_STACK_TRUNCATION != HARDFAULT_TRUNCATE_CUT && (HARDFAULT_STACK_RLE || HARDFAULT_STACK_DMA)
+#error "HARDFAULT_STACK_TRUNCATION requires a plain stack copy, disable HARDFAULT_STACK_RLE and HARDFAULT_STACK_DMA"
+#endif
+
+/**
+ * Save both the main stack and the process stack, whichever the violating context used, as tagged sections (DUMP_FLAG_SECTIONS).
+ * A task fault may be caused by an interrupt and the other way around, so the other stack is often the clue.
+ * Each stack is cut to its budget, HARDFAULT_MSP_SECTION_BUDGET and HARDFAULT_PSP_SECTION_BUDGET bytes.
+ * The stack of the violating context is saved from its sp. When a task faulted, the main stack is saved from
+ * HARDFAULT_MSP_SECTION_BUDGET bytes below its base, which keeps what the last interrupts left on it.
+ * The PSP is saved only when it points into the RAM, from HARDFAULT_RAM_START to the region reserved for the dumps.
+ */
+#ifndef HARDFAULT_CAPTURE_BOTH_STACKS
+#define HARDFAULT_CAPTURE_BOTH_STACKS 0
+#endif
+#ifndef HARDFAULT_MSP_SECTION_BUDGET
+#define HARDFAULT_MSP_SECTION_BUDGET (HARDFAULT_SLOT_SIZE / 4)
+#endif
+#ifndef HARDFAULT_PSP_SECTION_BUDGET
+#define HARDFAULT_PSP_SECTION_BUDGET (HARDFAULT_SLOT_SIZE / 2)
+#endif
+#ifndef HARDFAULT_RAM_START
+#ifdef HARDFAULT_HOST_SIM
+#define HARDFAULT_RAM_START HOSTSIM_RAM_BASE
+#else
+#define HARDFAULT_RAM_START 0x20000000
+#endif
+#endif
+/**
+ * Save memory regions registered with hardFault_registerRegion (scheduler state, the current task, log buffers...)
+ * in the dump, before the stack. The regions are saved by priority into HARDFAULT_REGION_BUDGET bytes of the slot,
+ * the last region that fits only partly is cut. The plan is computed when a region is registered, not by the handler.
+ */
+#ifndef HARDFAULT_CAPTURE_REGIONS
+#define HARDFAULT_CAPTURE_REGIONS 0
+#endif
+#ifndef HARDFAULT_MAX_REGIONS
+#define HARDFAULT_MAX_REGIONS 8
+#endif
+#ifndef HARDFAULT_REGION_BUDGET
+#define HARDFAULT_REGION_BUDGET (HARDFAULT_SLOT_SIZE / 4)
+#endif
+#if HARDFAULT_CAPTURE_REGIONS && HARDFAULT_REGION_BUDGET < 4
+#error "HARDFAULT_REGION_BUDGET must have room for the uint32_t count of the region table"
+#endif
+
+#if HARDFAULT_CAPTURE_BOTH_STACKS && (HARDFAULT_STACK_RLE || HARDFAULT_STACK_DMA || HARDFAULT_STACK_TRUNCATION != HARDFAULT_TRUNCATE_CUT)
+#error "HARDFAULT_CAPTURE_BOTH_STACKS requires a plain stack copy, disable HARDFAULT_STACK_RLE, HARDFAULT_STACK_DMA and HARDFAULT_STACK_TRUNCATION"
+#endif
+
+/**
+ * The HardFault_Handler moves to a stack of its own before running the capture, so a fault caused by an exhausted
+ * main stack can still be saved instead of faulting again into a lockup. 0 keeps the capture on the main stack.
+ */
+#ifndef HARDFAULT_FAULT_STACK_SIZE
+#define HARDFAULT_FAULT_STACK_SIZE 1024
+#endif
+
+/**
+ * Handle the MemManage, BusFault and UsageFault exceptions directly instead of letting them escalate to a HardFault,
+ * which keeps the precise fault type and saves the escalation. hardFault_init enables them.
+ * HARDFAULT_HANDLE_NMI saves a dump on an NMI as well, for systems that use the NMI as a watchdog or panic signal.
+ * All of them share the capture of the HardFault_Handler, the dump records which one ran (HARDFAULT_SOURCE_xxx).
+ * Only one capture runs at a time: an exception that preempts a capture (an NMI, or a HardFault during the capture of a
+ * configurable fault) resets the system right away, restarting the capture over the one it interrupted would corrupt both.
+ */
+#ifndef HARDFAULT_HANDLE_CONFIGURABLE_FAULTS
+#define HARDFAULT_HANDLE_CONFIGURABLE_FAULTS 0
+#endif
+#ifndef HARDFAULT_HANDLE_NMI
+#define HARDFAULT_HANDLE_NMI 0
+#endif
+
+/**
+ * Save a backtrace of the violating context in the dump, so the crash can be logged on the device without symbolising the stack
+ * NONE  - no backtrace
+ * EHABI - unwind with the ARM exception tables (.ARM.exidx and .ARM.extab), which GCC emits with -funwind-tables.
+ *         The linker file must define __exidx_start and __exidx_end around .ARM.exidx, as the usual GCC linker files do.
+ * SCAN  - without unwind tables, guess the return addresses: the stack words that point into the code ranges set by
+ *         hardFault_setCodeRanges, have the Thumb bit set and follow a BL/BLX instruction.
+ *         Stale return addresses of returned calls pass the test as well, so the backtrace may hold extra frames.
+ * The backtrace holds up to HARDFAULT_BACKTRACE_DEPTH addresses, and each frame runs at most HARDFAULT_UNWIND_MAX_OPCODES
+ * unwind instructions, so the unwinding time is bounded whatever the tables and the stack contain.
+ * The scan reads at most HARDFAULT_SCAN_MAX_WORDS stack words, each checked with a binary search of the code ranges.
+ */
+#define HARDFAULT_BACKTRACE_NONE 0
+#define HARDFAULT_BACKTRACE_EHABI 1
+#define HARDFAULT_BACKTRACE_SCAN 2
+
+#ifndef HARDFAULT_BACKTRACE
+#define HARDFAULT_BACKTRACE HARDFAULT_BACKTRACE_NONE
+#endif
+#ifndef HARDFAULT_BACKTRACE_DEPTH
+#define HARDFAULT_BACKTRACE_DEPTH 16
+#endif
+#ifndef HARDFAULT_UNWIND_MAX_OPCODES
+#define HARDFAULT_UNWIND_MAX_OPCODES 32
+#endif
+#ifndef HARDFAULT_SCAN_MAX_WORDS
+#define HARDFAULT_SCAN_MAX_WORDS 1024
+#endif
+#ifndef HARDFAULT_MAX_CODE_RANGES
+#define HARDFAULT_MAX_CODE_RANGES 8
+#endif
+
+#ifdef HARDFAULT_HOST_SIM
+#define SAVE_FPU_S0_S15(S) memcpy((S), &hostSim_fpuRegisters[0], 16 * sizeof(uint32_t))
+#define SAVE_FPU_S16_S31(S) memcpy((S), &hostSim_fpuRegisters[16], 16 * sizeof(uint32_t))
+#else
+#define SAVE_FPU_S0_S15(S) __ASM volatile ("vstmia %0, {s0-s15}" : : "r" (S) : "memory")
+#define SAVE_FPU_S16_S31(S) __ASM volatile ("vstmia %0, {s16-s31}" : : "r" (S) : "memory")
+#endif
+
+
+/**
+ * The dump format is defined in hardFault_handler.h
+ * each slot starts with a dump_header_t, padded to the program unit of the storage
+ */
+#define HARDFAULT_SLOT_HEADER_SIZE HARDFAULT_ALIGN_UP(sizeof(dump_header_t), HARDFAULT_STORAGE_WRITE_UNIT)
+
+_Static_assert(HARDFAULT_SLOT_SIZE >= HARDFAULT_SLOT_HEADER_SIZE + sizeof(core_dump_t),
+               "HARDFAULT_SLOT_SIZE is too small for a dump, each of the HARDFAULT_SLOT_COUNT slots needs at least one erase unit of the reserved region");
+
+#ifdef HARDFAULT_HOST_SIM
+const hostSim_storage_t hostSim_storage = {
+	hostSim_storageData, ERROR_HANDELING_MEMORY_ADDRESS, ERROR_HANDELING_MEMORY_SIZE,
+	HARDFAULT_STORAGE_ERASE_UNIT, HARDFAULT_STORAGE_WRITE_UNIT, HARDFAULT_SLOT_COUNT, HARDFAULT_SLOT_SIZE, HARDFAULT_SLOT_HEADER_SIZE
+};
+#endif
+
+// --------------------------------------------------------------------------------------
+static inline uint32_t getMainStackBase(void)
+{
+#ifdef HARDFAULT_HOST_SIM
+	return hostSim_mainStackBase;
+#else
+	extern uint32_t _estack[]; //stack start address definition in the linker file
+	return (uint32_t)_estack;
+#endif
+}
+
+/**
+ * How the stack of a task (process stack) is found
+ * FIXED      - assume the task stack ends HARDFAULT_TASK_STACK_FIXED_SIZE bytes above the sp
+ * REGISTERED - look up the sp in a table of task stacks registered with hardFault_registerTaskStack,
+ *              so exactly the used part of the stack is saved. Falls back to FIXED if the sp isn't in any of them.
+ *
+ * With FreeRTOS (configRECORD_STACK_HIGH_ADDRESS set to 1) the table can be maintained by the trace hooks in FreeRTOSConfig.h:
+ * #define traceTASK_CREATE(pxNewTCB) hardFault_registerTaskStack((uint32_t)(pxNewTCB)->pxStack, (uint32_t)((pxNewTCB)->pxEndOfStack + 1))
+ * #define traceTASK_DELETE(pxTCB) hardFault_unregisterTaskStack((uint32_t)(pxTCB)->pxStack)
+ */
+#define HARDFAULT_TASK_STACK_FIXED 0
+#define HARDFAULT_TASK_STACK_REGISTERED 1
+
+#ifndef HARDFAULT_TASK_STACK_MODE
+#define HARDFAULT_TASK_STACK_MODE HARDFAULT_TASK_STACK_FIXED
+#endif
+#ifndef HARDFAULT_TASK_STACK_FIXED_SIZE
+#define HARDFAULT_TASK_STACK_FIXED_SIZE 1024
+#endif
+#ifndef HARDFAULT_MAX_TASKS
+#define HARDFAULT_MAX_TASKS 16
+#endif
+
+#if HARDFAULT_TASK_STACK_MODE == HARDFAULT_TASK_STACK_REGISTERED
+/**
+ * the stack of a task spans [start, end), start == 0 marks a free entry
+ */
+typedef struct task_stack_t {
+	volatile uint32_t start;
+	volatile uint32_t end;
+}task_stack_t;
+
+static task_stack_t taskStacks[HARDFAULT_MAX_TASKS];
+
+/**
+ * register the stack of a task, the stack spans [stackStart, stackEnd)
+ * return - true: registered, false: the table is full
+ */
+bool hardFault_registerTaskStack(uint32_t stackStart, uint32_t stackEnd)
+{
+	for (uint32_t i = 0; i < HARDFAULT_MAX_TASKS; i++)
+	{
+		if (taskStacks[i].start != 0)
+			continue;
+		/* the entry becomes visible to the handler only once start is set */
+		taskStacks[i].end = stackEnd;
+		taskStacks[i].start = stackStart;
+		return true;
+	}
+	return false;
+}
+
+void hardFault_unregisterTaskStack(uint32_t stackStart)
+{
+	for (uint32_t i = 0; i < HARDFAULT_MAX_TASKS; i++)
+	{
+		if (taskStacks[i].start == stackStart)
+			taskStacks[i].start = 0;
+	}
+}
+#endif
+
+static inline uint32_t getTaskStackBase(uint32_t sp)
+{
+	/* return the start of the stack of the last running task */
+#if HARDFAULT_TASK_STACK_MODE == HARDFAULT_TASK_STACK_REGISTERED
+	for (uint32_t i = 0; i < HARDFAULT_MAX_TASKS; i++)
+	{
+		if (taskStacks[i].start != 0 && taskStacks[i].start <= sp && sp < taskStacks[i].end)
+			return taskStacks[i].end;
+	}
+#endif
+	return sp + HARDFAULT_TASK_STACK_FIXED_SIZE;
+}
+
+static inline uint32_t getStackBase(uint32_t sp, uint32_t excReturn)
+{
+	/* bit 2 of the EXC_RETURN tells which stack the hardware pushed the exception frame on.
+	 * Comparing the sp with the PSP isn't enough: both stack pointers may hold the same value,
+	 * and a tail chained exception may have moved the PSP since. */
+	if (excReturn & EXC_RETURN_PROCESS_STACK)
+		return getTaskStackBase(sp);
+	else
+		return getMainStackBase();
+}
+
+// --------------------------------------------------------------------------------------
+
+#if HARDFAULT_CAPTURE_REGIONS
+/**
+ * a registered region, the table is kept sorted by priority
+ */
+typedef struct region_t {
+	uint32_t address;
+	uint32_t length;
+	uint32_t priority;
+	uint32_t tag;
+}region_t;
+
+static region_t regions[HARDFAULT_MAX_REGIONS];
+static uint32_t regionCount;
+
+/**
+ * what the handler saves: the first regions by priority, cut to HARDFAULT_REGION_BUDGET
+ */
+static dump_section_t regionPlan[HARDFAULT_MAX_REGIONS];
+static volatile uint32_t regionPlanCount;
+
+static void prvPlanRegions(void)
+{
+	/* the handler doesn't use the plan while it's being updated */
+	regionPlanCount = 0;
+
+	uint32_t budget = HARDFAULT_REGION_BUDGET - sizeof(uint32_t); // the count of the table
+	uint32_t count = 0;
+	for (uint32_t i = 0; i < regionCount && budget > sizeof(dump_section_t); i++)
+	{
+		regionPlan[count].tag = regions[i].tag;
+		regionPlan[count].address = regions[i].address;
+		regionPlan[count].length = MIN(regions[i].length, budget - sizeof(dump_section_t));
+		budget -= sizeof(dump_section_t) + regionPlan[count].length;
+		count++;
+	}
+	regionPlanCount = count;
+}
+
+/**
+ * register a memory region to save in the dump, at init time
+ * priority - higher priorities are saved first, regions of the same priority in the order they were registered
+ * tag      - identifies the region in the dump (the tag of its dump_section_t)
+ * return - true: registered, false: the table is full
+ */
+bool hardFault_registerRegion(const void* address, uint32_t length, uint32_t priority, uint32_t tag)
+{
+	if (regionCount == HARDFAULT_MAX_REGIONS)
+		return false;
+
+	uint32_t i = regionCount++;
+	for (; i > 0 && regions[i - 1].priority < priority; i--)
+		regions[i] = regions[i - 1];
+	regions[i] = (region_t){ .address = (uint32_t)(uintptr_t)address, .length = length, .priority = priority, .tag = tag };
+	prvPlanRegions();
+	return true;
+}
+#endif
+
+// --------------------------------------------------------------------------------------
+
+/**
+ * The CRC-32 used for the dump integrity
+ * SOFTWARE - slice-by-8, processes 8 bytes per step using 8KB of constant tables
+ * HARDWARE - the CRC peripheral of the MCU, through the device specific crc_hwUpdate
+ */
+#define HARDFAULT_CRC_SOFTWARE 0
+#define HARDFAULT_CRC_HARDWARE 1
+
+#ifndef HARDFAULT_CRC_ENGINE
+#define HARDFAULT_CRC_ENGINE HARDFAULT_CRC_SOFTWARE
+#endif
+
+#if HARDFAULT_CRC_ENGINE == HARDFAULT_CRC_HARDWARE
+/* device specific
+ * must return the same value as the software engine: reflected CRC-32 with polynomial 0x04C11DB7,
+ * continuing from crc (load ~crc as the initial value, enable input/output bit reversal and invert the result) */
+uint32_t crc_hwUpdate(uint32_t crc, const void* data, uint32_t length);
+
+/**
+ * update a CRC-32 with more data, start with crc = 0
+ */
+static uint32_t prvCrc32(uint32_t crc, const void* data, uint32_t length)
+{
+	return crc_hwUpdate(crc, data, length);
+}
+
+#elif HARDFAULT_CRC_ENGINE == HARDFAULT_CRC_SOFTWARE
+/**
+ * crc32Table[0] is the standard byte table, crc32Table[k] is the CRC of a byte followed by k zero bytes
+ */
+static const uint32_t crc32Table[8][256] = {
+	{
+		0x00000000, 0x77073096, 0xEE0E612C, 0x990951BA, 0x076DC419, 0x706AF48F, 0xE963A535, 0x9E6495A3,
+		0x0EDB8832, 0x79DCB8A4, 0xE0D5E91E, 0x97D2D988, 0x09B64C2B, 0x7EB17CBD, 0xE7B82D07, 0x90BF1D91,
+		0x1DB71064, 0x6AB020F2, 0xF3B97148, 0x84BE41DE, 0x1ADAD47D, 0x6DDDE4EB, 0xF4D4B551, 0x83D385C7,
+		0x136C9856, 0x646BA8C0, 0xFD62F97A, 0x8A65C9EC, 0x14015C4F, 0x63066CD9, 0xFA0F3D63, 0x8D080DF5,
+		0x3B6E20C8, 0x4C69105E, 0xD56041E4, 0xA2677172, 0x3C03E4D1, 0x4B04D447, 0xD20D85FD, 0xA50AB56B,
+		0x35B5A8FA, 0x42B2986C, 0xDBBBC9D6, 0xACBCF940, 0x32D86CE3, 0x45DF5C75, 0xDCD60DCF, 0xABD13D59,
+		0x26D930AC, 0x51DE003A, 0xC8D75180, 0xBFD06116, 0x21B4F4B5, 0x56B3C423, 0xCFBA9599, 0xB8BDA50F,
+		0x2802B89E, 0x5F058808, 0xC60CD9B2, 0xB10BE924, 0x2F6F7C87, 0x58684C11, 0xC1611DAB, 0xB6662D3D,
+		0x76DC4190, 0x01DB7106, 0x98D220BC, 0xEFD5102A, 0x71B18589, 0x06B6B51F, 0x9FBFE4A5, 0xE8B8D433,
+		0x7807C9A2, 0x0F00F934, 0x9609A88E, 0xE10E9818, 0x7F6A0DBB, 0x086D3D2D, 0x91646C97, 0xE6635C01,
+		0x6B6B51F4, 0x1C6C6162, 0x856530D8, 0xF262004E, 0x6C0695ED, 0x1B01A57B, 0x8208F4C1, 0xF50FC457,
+		0x65B0D9C6, 0x12B7E950, 0x8BBEB8EA, 0xFCB9887C, 0x62DD1DDF, 0x15DA2D49, 0x8CD37CF3, 0xFBD44C65,
+		0x4DB26158, 0x3AB551CE, 0xA3BC0074, 0xD4BB30E2, 0x4ADFA541, 0x3DD895D7, 0xA4D1C46D, 0xD3D6F4FB,
+		0x4369E96A, 0x346ED9FC, 0xAD678846, 0xDA60B8D0, 0x44042D73, 0x33031DE5, 0xAA0A4C5F, 0xDD0D7CC9,
+		0x5005713C, 0x270241AA, 0xBE0B1010, 0xC90C2086, 0x5768B525, 0x206F85B3, 0xB966D409, 0xCE61E49F,
+		0x5EDEF90E, 0x29D9C998, 0xB0D09822, 0xC7D7A8B4, 0x59B33D17, 0x2EB40D81, 0xB7BD5C3B, 0xC0BA6CAD,
+		0xEDB88320, 0x9ABFB3B6, 0x03B6E20C, 0x74B1D29A, 0xEAD54739, 0x9DD277AF, 0x04DB2615, 0x73DC1683,
+		0xE3630B12, 0x94643B84, 0x0D6D6A3E, 0x7A6A5AA8, 0xE40ECF0B, 0x9309FF9D, 0x0A00AE27, 0x7D079EB1,
+		0xF00F9344, 0x8708A3D2, 0x1E01F268, 0x6906C2FE, 0xF762575D, 0x806567CB, 0x196C3671, 0x6E6B06E7,
+		0xFED41B76, 0x89D32BE0, 0x10DA7A5A, 0x67DD4ACC, 0xF9B9DF6F, 0x8EBEEFF9, 0x17B7BE43, 0x60B08ED5,
+		0xD6D6A3E8, 0xA1D1937E, 0x38D8C2C4, 0x4FDFF252, 0xD1BB67F1, 0xA6BC5767, 0x3FB506DD, 0x48B2364B,
+		0xD80D2BDA, 0xAF0A1B4C, 0x36034AF6, 0x41047A60, 0xDF60EFC3, 0xA867DF55, 0x316E8EEF, 0x4669BE79,
+		0xCB61B38C, 0xBC66831A, 0x256FD2A0, 0x5268E236, 0xCC0C7795, 0xBB0B4703, 0x220216B9, 0x5505262F,
+		0xC5BA3BBE, 0xB2BD0B28, 0x2BB45A92, 0x5CB36A04, 0xC2D7FFA7, 0xB5D0CF31, 0x2CD99E8B, 0x5BDEAE1D,
+		0x9B64C2B0, 0xEC63F226, 0x756AA39C, 0x026D930A, 0x9C0906A9, 0xEB0E363F, 0x72076785, 0x05005713,
+		0x95BF4A82, 0xE2B87A14, 0x7BB12BAE, 0x0CB61B38, 0x92D28E9B, 0xE5D5BE0D, 0x7CDCEFB7, 0x0BDBDF21,
+		0x86D3D2D4, 0xF1D4E242, 0x68DDB3F8, 0x1FDA836E, 0x81BE16CD, 0xF6B9265B, 0x6FB077E1, 0x18B74777,
+		0x88085AE6, 0xFF0F6A70, 0x66063BCA, 0x11010B5C, 0x8F659EFF, 0xF862AE69, 0x616BFFD3, 0x166CCF45,
+		0xA00AE278, 0xD70DD2EE, 0x4E048354, 0x3903B3C2, 0xA7672661, 0xD06016F7, 0x4969474D, 0x3E6E77DB,
+		0xAED16A4A, 0xD9D65ADC, 0x40DF0B66, 0x37D83BF0, 0xA9BCAE53, 0xDEBB9EC5, 0x47B2CF7F, 0x30B5FFE9,
+		0xBDBDF21C, 0xCABAC28A, 0x53B39330, 0x24B4A3A6, 0xBAD03605, 0xCDD70693, 0x54DE5729, 0x23D967BF,
+		0xB3667A2E, 0xC4614AB8, 0x5D681B02, 0x2A6F2B94, 0xB40BBE37, 0xC30C8EA1, 0x5A05DF1B, 0x2D02EF8D,
+	},
+	{
+		0x00000000, 0x191B3141, 0x32366282, 0x2B2D53C3, 0x646CC504, 0x7D77F445, 0x565AA786, 0x4F4196C7,
+		0xC8D98A08, 0xD1C2BB49, 0xFAEFE88A, 0xE3F4D9CB, 0xACB54F0C, 0xB5AE7E4D, 0x9E832D8E, 0x87981CCF,
+		0x4AC21251, 0x53D92310, 0x78F470D3, 0x61EF4192, 0x2EAED755, 0x37B5E614, 0x1C98B5D7, 0x05838496,
+		0x821B9859, 0x9B00A918, 0xB02DFADB, 0xA936CB9A, 0xE6775D5D, 0xFF6C6C1C, 0xD4413FDF, 0xCD5A0E9E,
+		0x958424A2, 0x8C9F15E3, 0xA7B24620, 0xBEA97761, 0xF1E8E1A6, 0xE8F3D0E7, 0xC3DE8324, 0xDAC5B265,
+		0x5D5DAEAA, 0x44469FEB, 0x6F6BCC28, 0x7670FD69, 0x39316BAE, 0x202A5AEF, 0x0B07092C, 0x121C386D,
+		0xDF4636F3, 0xC65D07B2, 0xED705471, 0xF46B6530, 0xBB2AF3F7, 0xA231C2B6, 0x891C9175, 0x9007A034,
+		0x179FBCFB, 0x0E848DBA, 0x25A9DE79, 0x3CB2EF38, 0x73F379FF, 0x6AE848BE, 0x41C51B7D, 0x58DE2A3C,
+		0xF0794F05, 0xE9627E44, 0xC24F2D87, 0xDB541CC6, 0x94158A01, 0x8D0EBB40, 0xA623E883, 0xBF38D9C2,
+		0x38A0C50D, 0x21BBF44C, 0x0A96A78F, 0x138D96CE, 0x5CCC0009, 0x45D73148, 0x6EFA628B, 0x77E153CA,
+		0xBABB5D54, 0xA3A06C15, 0x888D3FD6, 0x91960E97, 0xDED79850, 0xC7CCA911, 0xECE1FAD2, 0xF5FACB93,
+		0x7262D75C, 0x6B79E61D, 0x4054B5DE, 0x594F849F, 0x160E1258, 0x0F152319, 0x243870DA, 0x3D23419B,
+		0x65FD6BA7, 0x7CE65AE6, 0x57CB0925, 0x4ED03864, 0x0191AEA3, 0x188A9FE2, 0x33A7CC21, 0x2ABCFD60,
+		0xAD24E1AF, 0xB43FD0EE, 0x9F12832D, 0x8609B26C, 0xC94824AB, 0xD05315EA, 0xFB7E4629, 0xE2657768,
+		0x2F3F79F6, 0x362448B7, 0x1D091B74, 0x04122A35, 0x4B53BCF2, 0x52488DB3, 0x7965DE70, 0x607EEF31,
+		0xE7E6F3FE, 0xFEFDC2BF, 0xD5D0917C, 0xCCCBA03D, 0x838A36FA, 0x9A9107BB, 0xB1BC5478, 0xA8A76539,
+		0x3B83984B, 0x2298A90A, 0x09B5FAC9, 0x10AECB88, 0x5FEF5D4F, 0x46F46C0E, 0x6DD93FCD, 0x74C20E8C,
+		0xF35A1243, 0xEA412302, 0xC16C70C1, 0xD8774180, 0x9736D747, 0x8E2DE606, 0xA500B5C5, 0xBC1B8484,
+		0x71418A1A, 0x685ABB5B, 0x4377E898, 0x5A6CD9D9, 0x152D4F1E, 0x0C367E5F, 0x271B2D9C, 0x3E001CDD,
+		0xB9980012, 0xA0833153, 0x8BAE6290, 0x92B553D1, 0xDDF4C516, 0xC4EFF457, 0xEFC2A794, 0xF6D996D5,
+		0xAE07BCE9, 0xB71C8DA8, 0x9C31DE6B, 0x852AEF2A, 0xCA6B79ED, 0xD37048AC, 0xF85D1B6F, 0xE1462A2E,
+		0x66DE36E1, 0x7FC507A0, 0x54E85463, 0x4DF36522, 0x02B2F3E5, 0x1BA9C2A4, 0x30849167, 0x299FA026,
+		0xE4C5AEB8, 0xFDDE9FF9, 0xD6F3CC3A, 0xCFE8FD7B, 0x80A96BBC, 0x99B25AFD, 0xB29F093E, 0xAB84387F,
+		0x2C1C24B0, 0x350715F1, 0x1E2A4632, 0x07317773, 0x4870E1B4, 0x516BD0F5, 0x7A468336, 0x635DB277,
+		0xCBFAD74E, 0xD2E1E60F, 0xF9CCB5CC, 0xE0D7848D, 0xAF96124A, 0xB68D230B, 0x9DA070C8, 0x84BB4189,
+		0x03235D46, 0x1A386C07, 0x31153FC4, 0x280E0E85, 0x674F9842, 0x7E54A903, 0x5579FAC0, 0x4C62CB81,
+		0x8138C51F, 0x9823F45E, 0xB30EA79D, 0xAA1596DC, 0xE554001B, 0xFC4F315A, 0xD7626299, 0xCE7953D8,
+		0x49E14F17, 0x50FA7E56, 0x7BD72D95, 0x62CC1CD4, 0x2D8D8A13, 0x3496BB52, 0x1FBBE891, 0x06A0D9D0,
+		0x5E7EF3EC, 0x4765C2AD, 0x6C48916E, 0x7553A02F, 0x3A1236E8, 0x230907A9, 0x0824546A, 0x113F652B,
+		0x96A779E4, 0x8FBC48A5, 0xA4911B66, 0xBD8A2A27, 0xF2CBBCE0, 0xEBD08DA1, 0xC0FDDE62, 0xD9E6EF23,
+		0x14BCE1BD, 0x0DA7D0FC, 0x268A833F, 0x3F91B27E, 0x70D024B9, 0x69CB15F8, 0x42E6463B, 0x5BFD777A,
+		0xDC656BB5, 0xC57E5AF4, 0xEE530937, 0xF7483876, 0xB809AEB1, 0xA1129FF0, 0x8A3FCC33, 0x9324FD72,
+	},
+	{
+		0x00000000, 0x01C26A37, 0x0384D46E, 0x0246BE59, 0x0709A8DC, 0x06CBC2EB, 0x048D7CB2, 0x054F1685,
+		0x0E1351B8, 0x0FD13B8F, 0x0D9785D6, 0x0C55EFE1, 0x091AF964, 0x08D89353, 0x0A9E2D0A, 0x0B5C473D,
+		0x1C26A370, 0x1DE4C947, 0x1FA2771E, 0x1E601D29, 0x1B2F0BAC, 0x1AED619B, 0x18ABDFC2, 0x1969B5F5,
+		0x1235F2C8, 0x13F798FF, 0x11B126A6, 0x10734C91, 0x153C5A14, 0x14FE3023, 0x16B88E7A, 0x177AE44D,
+		0x384D46E0, 0x398F2CD7, 0x3BC9928E, 0x3A0BF8B9, 0x3F44EE3C, 0x3E86840B, 0x3CC03A52, 0x3D025065,
+		0x365E1758, 0x379C7D6F, 0x35DAC336, 0x3418A901, 0x3157BF84, 0x3095D5B3, 0x32D36BEA, 0x331101DD,
+		0x246BE590, 0x25A98FA7, 0x27EF31FE, 0x262D5BC9, 0x23624D4C, 0x22A0277B, 0x20E69922, 0x2124F315,
+		0x2A78B428, 0x2BBADE1F, 0x29FC6046, 0x283E0A71, 0x2D711CF4, 0x2CB376C3, 0x2EF5C89A, 0x2F37A2AD,
+		0x709A8DC0, 0x7158E7F7, 0x731E59AE, 0x72DC3399, 0x7793251C, 0x76514F2B, 0x7417F172, 0x75D59B45,
+		0x7E89DC78, 0x7F4BB64F, 0x7D0D0816, 0x7CCF6221, 0x798074A4, 0x78421E93, 0x7A04A0CA, 0x7BC6CAFD,
+		0x6CBC2EB0, 0x6D7E4487, 0x6F38FADE, 0x6EFA90E9, 0x6BB5866C, 0x6A77EC5B, 0x68315202, 0x69F33835,
+		0x62AF7F08, 0x636D153F, 0x612BAB66, 0x60E9C151, 0x65A6D7D4, 0x6464BDE3, 0x662203BA, 0x67E0698D,
+		0x48D7CB20, 0x4915A117, 0x4B531F4E, 0x4A917579, 0x4FDE63FC, 0x4E1C09CB, 0x4C5AB792, 0x4D98DDA5,
+		0x46C49A98, 0x4706F0AF, 0x45404EF6, 0x448224C1, 0x41CD3244, 0x400F5873, 0x4249E62A, 0x438B8C1D,
+		0x54F16850, 0x55330267, 0x5775BC3E, 0x56B7D609, 0x53F8C08C, 0x523AAABB, 0x507C14E2, 0x51BE7ED5,
+		0x5AE239E8, 0x5B2053DF, 0x5966ED86, 0x58A487B1, 0x5DEB9134, 0x5C29FB03, 0x5E6F455A, 0x5FAD2F6D,
+		0xE1351B80, 0xE0F771B7, 0xE2B1CFEE, 0xE373A5D9, 0xE63CB35C, 0xE7FED96B, 0xE5B86732, 0xE47A0D05,
+		0xEF264A38, 0xEEE4200F, 0xECA29E56, 0xED60F461, 0xE82FE2E4, 0xE9ED88D3, 0xEBAB368A, 0xEA695CBD,
+		0xFD13B8F0, 0xFCD1D2C7, 0xFE976C9E, 0xFF5506A9, 0xFA1A102C, 0xFBD87A1B, 0xF99EC442, 0xF85CAE75,
+		0xF300E948, 0xF2C2837F, 0xF0843D26, 0xF1465711, 0xF4094194, 0xF5CB2BA3, 0xF78D95FA, 0xF64FFFCD,
+		0xD9785D60, 0xD8BA3757, 0xDAFC890E, 0xDB3EE339, 0xDE71F5BC, 0xDFB39F8B, 0xDDF521D2, 0xDC374BE5,
+		0xD76B0CD8, 0xD6A966EF, 0xD4EFD8B6, 0xD52DB281, 0xD062A404, 0xD1A0CE33, 0xD3E6706A, 0xD2241A5D,
+		0xC55EFE10, 0xC49C9427, 0xC6DA2A7E, 0xC7184049, 0xC25756CC, 0xC3953CFB, 0xC1D382A2, 0xC011E895,
+		0xCB4DAFA8, 0xCA8FC59F, 0xC8C97BC6, 0xC90B11F1, 0xCC440774, 0xCD866D43, 0xCFC0D31A, 0xCE02B92D,
+		0x91AF9640, 0x906DFC77, 0x922B422E, 0x93E92819, 0x96A63E9C, 0x976454AB, 0x9522EAF2, 0x94E080C5,
+		0x9FBCC7F8, 0x9E7EADCF, 0x9C381396, 0x9DFA79A1, 0x98B56F24, 0x99770513, 0x9B31BB4A, 0x9AF3D17D,
+		0x8D893530, 0x8C4B5F07, 0x8E0DE15E, 0x8FCF8B69, 0x8A809DEC, 0x8B42F7DB, 0x89044982, 0x88C623B5,
+		0x839A6488, 0x82580EBF, 0x801EB0E6, 0x81DCDAD1, 0x8493CC54, 0x8551A663, 0x8717183A, 0x86D5720D,
+		0xA9E2D0A0, 0xA820BA97, 0xAA6604CE, 0xABA46EF9, 0xAEEB787C, 0xAF29124B, 0xAD6FAC12, 0xACADC625,
+		0xA7F18118, 0xA633EB2F, 0xA4755576, 0xA5B73F41, 0xA0F829C4, 0xA13A43F3, 0xA37CFDAA, 0xA2BE979D,
+		0xB5C473D0, 0xB40619E7, 0xB640A7BE, 0xB782CD89, 0xB2CDDB0C, 0xB30FB13B, 0xB1490F62, 0xB08B6555,
+		0xBBD72268, 0xBA15485F, 0xB853F606, 0xB9919C31, 0xBCDE8AB4, 0xBD1CE083, 0xBF5A5EDA, 0xBE9834ED,
+	},
+	{
+		0x00000000, 0xB8BC6765, 0xAA09C88B, 0x12B5AFEE, 0x8F629757, 0x37DEF032, 0x256B5FDC, 0x9DD738B9,
+		0xC5B428EF, 0x7D084F8A, 0x6FBDE064, 0xD7018701, 0x4AD6BFB8, 0xF26AD8DD, 0xE0DF7733, 0x58631056,
+		0x5019579F, 0xE8A530FA, 0xFA109F14, 0x42ACF871, 0xDF7BC0C8, 0x67C7A7AD, 0x75720843, 0xCDCE6F26,
+		0x95AD7F70, 0x2D111815, 0x3FA4B7FB, 0x8718D09E, 0x1ACFE827, 0xA2738F42, 0xB0C620AC, 0x087A47C9,
+		0xA032AF3E, 0x188EC85B, 0x0A3B67B5, 0xB28700D0, 0x2F503869, 0x97EC5F0C, 0x8559F0E2, 0x3DE59787,
+		0x658687D1, 0xDD3AE0B4, 0xCF8F4F5A, 0x7733283F, 0xEAE41086, 0x525877E3, 0x40EDD80D, 0xF851BF68,
+		0xF02BF8A1, 0x48979FC4, 0x5A22302A, 0xE29E574F, 0x7F496FF6, 0xC7F50893, 0xD540A77D, 0x6DFCC018,
+		0x359FD04E, 0x8D23B72B, 0x9F9618C5, 0x272A7FA0, 0xBAFD4719, 0x0241207C, 0x10F48F92, 0xA848E8F7,
+		0x9B14583D, 0x23A83F58, 0x311D90B6, 0x89A1F7D3, 0x1476CF6A, 0xACCAA80F, 0xBE7F07E1, 0x06C36084,
+		0x5EA070D2, 0xE61C17B7, 0xF4A9B859, 0x4C15DF3C, 0xD1C2E785, 0x697E80E0, 0x7BCB2F0E, 0xC377486B,
+		0xCB0D0FA2, 0x73B168C7, 0x6104C729, 0xD9B8A04C, 0x446F98F5, 0xFCD3FF90, 0xEE66507E, 0x56DA371B,
+		0x0EB9274D, 0xB6054028, 0xA4B0EFC6, 0x1C0C88A3, 0x81DBB01A, 0x3967D77F, 0x2BD27891, 0x936E1FF4,
+		0x3B26F703, 0x839A9066, 0x912F3F88, 0x299358ED, 0xB4446054, 0x0CF80731, 0x1E4DA8DF, 0xA6F1CFBA,
+		0xFE92DFEC, 0x462EB889, 0x549B1767, 0xEC277002, 0x71F048BB, 0xC94C2FDE, 0xDBF98030, 0x6345E755,
+		0x6B3FA09C, 0xD383C7F9, 0xC1366817, 0x798A0F72, 0xE45D37CB, 0x5CE150AE, 0x4E54FF40, 0xF6E89825,
+		0xAE8B8873, 0x1637EF16, 0x048240F8, 0xBC3E279D, 0x21E91F24, 0x99557841, 0x8BE0D7AF, 0x335CB0CA,
+		0xED59B63B, 0x55E5D15E, 0x47507EB0, 0xFFEC19D5, 0x623B216C, 0xDA874609, 0xC832E9E7, 0x708E8E82,
+		0x28ED9ED4, 0x9051F9B1, 0x82E4565F, 0x3A58313A, 0xA78F0983, 0x1F336EE6, 0x0D86C108, 0xB53AA66D,
+		0xBD40E1A4, 0x05FC86C1, 0x1749292F, 0xAFF54E4A, 0x322276F3, 0x8A9E1196, 0x982BBE78, 0x2097D91D,
+		0x78F4C94B, 0xC048AE2E, 0xD2FD01C0, 0x6A4166A5, 0xF7965E1C, 0x4F2A3979, 0x5D9F9697, 0xE523F1F2,
+		0x4D6B1905, 0xF5D77E60, 0xE762D18E, 0x5FDEB6EB, 0xC2098E52, 0x7AB5E937, 0x680046D9, 0xD0BC21BC,
+		0x88DF31EA, 0x3063568F, 0x22D6F961, 0x9A6A9E04, 0x07BDA6BD, 0xBF01C1D8, 0xADB46E36, 0x15080953,
+		0x1D724E9A, 0xA5CE29FF, 0xB77B8611, 0x0FC7E174, 0x9210D9CD, 0x2AACBEA8, 0x38191146, 0x80A57623,
+		0xD8C66675, 0x607A0110, 0x72CFAEFE, 0xCA73C99B, 0x57A4F122, 0xEF189647, 0xFDAD39A9, 0x45115ECC,
+		0x764DEE06, 0xCEF18963, 0xDC44268D, 0x64F841E8, 0xF92F7951, 0x41931E34, 0x5326B1DA, 0xEB9AD6BF,
+		0xB3F9C6E9, 0x0B45A18C, 0x19F00E62, 0xA14C6907, 0x3C9B51BE, 0x842736DB, 0x96929935, 0x2E2EFE50,
+		0x2654B999, 0x9EE8DEFC, 0x8C5D7112, 0x34E11677, 0xA9362ECE, 0x118A49AB, 0x033FE645, 0xBB838120,
+		0xE3E09176, 0x5B5CF613, 0x49E959FD, 0xF1553E98, 0x6C820621, 0xD43E6144, 0xC68BCEAA, 0x7E37A9CF,
+		0xD67F4138, 0x6EC3265D, 0x7C7689B3, 0xC4CAEED6, 0x591DD66F, 0xE1A1B10A, 0xF3141EE4, 0x4BA87981,
+		0x13CB69D7, 0xAB770EB2, 0xB9C2A15C, 0x017EC639, 0x9CA9FE80, 0x241599E5, 0x36A0360B, 0x8E1C516E,
+		0x866616A7, 0x3EDA71C2, 0x2C6FDE2C, 0x94D3B949, 0x090481F0, 0xB1B8E695, 0xA30D497B, 0x1BB12E1E,
+		0x43D23E48, 0xFB6E592D, 0xE9DBF6C3, 0x516791A6, 0xCCB0A91F, 0x740CCE7A, 0x66B96194, 0xDE0506F1,
+	},
+	{
+		0x00000000, 0x3D6029B0, 0x7AC05360, 0x47A07AD0, 0xF580A6C0, 0xC8E08F70, 0x8F40F5A0, 0xB220DC10,
+		0x30704BC1, 0x0D106271, 0x4AB018A1, 0x77D03111, 0xC5F0ED01, 0xF890C4B1, 0xBF30BE61, 0x825097D1,
+		0x60E09782, 0x5D80BE32, 0x1A20C4E2, 0x2740ED52, 0x95603142, 0xA80018F2, 0xEFA06222, 0xD2C04B92,
+		0x5090DC43, 0x6DF0F5F3, 0x2A508F23, 0x1730A693, 0xA5107A83, 0x98705333, 0xDFD029E3, 0xE2B00053,
+		0xC1C12F04, 0xFCA106B4, 0xBB017C64, 0x866155D4, 0x344189C4, 0x0921A074, 0x4E81DAA4, 0x73E1F314,
+		0xF1B164C5, 0xCCD14D75, 0x8B7137A5, 0xB6111E15, 0x0431C205, 0x3951EBB5, 0x7EF19165, 0x4391B8D5,
+		0xA121B886, 0x9C419136, 0xDBE1EBE6, 0xE681C256, 0x54A11E46, 0x69C137F6, 0x2E614D26, 0x13016496,
+		0x9151F347, 0xAC31DAF7, 0xEB91A027, 0xD6F18997, 0x64D15587, 0x59B17C37, 0x1E1106E7, 0x23712F57,
+		0x58F35849, 0x659371F9, 0x22330B29, 0x1F532299, 0xAD73FE89, 0x9013D739, 0xD7B3ADE9, 0xEAD38459,
+		0x68831388, 0x55E33A38, 0x124340E8, 0x2F236958, 0x9D03B548, 0xA0639CF8, 0xE7C3E628, 0xDAA3CF98,
+		0x3813CFCB, 0x0573E67B, 0x42D39CAB, 0x7FB3B51B, 0xCD93690B, 0xF0F340BB, 0xB7533A6B, 0x8A3313DB,
+		0x0863840A, 0x3503ADBA, 0x72A3D76A, 0x4FC3FEDA, 0xFDE322CA, 0xC0830B7A, 0x872371AA, 0xBA43581A,
+		0x9932774D, 0xA4525EFD, 0xE3F2242D, 0xDE920D9D, 0x6CB2D18D, 0x51D2F83D, 0x167282ED, 0x2B12AB5D,
+		0xA9423C8C, 0x9422153C, 0xD3826FEC, 0xEEE2465C, 0x5CC29A4C, 0x61A2B3FC, 0x2602C92C, 0x1B62E09C,
+		0xF9D2E0CF, 0xC4B2C97F, 0x8312B3AF, 0xBE729A1F, 0x0C52460F, 0x31326FBF, 0x7692156F, 0x4BF23CDF,
+		0xC9A2AB0E, 0xF4C282BE, 0xB362F86E, 0x8E02D1DE, 0x3C220DCE, 0x0142247E, 0x46E25EAE, 0x7B82771E,
+		0xB1E6B092, 0x8C869922, 0xCB26E3F2, 0xF646CA42, 0x44661652, 0x79063FE2, 0x3EA64532, 0x03C66C82,
+		0x8196FB53, 0xBCF6D2E3, 0xFB56A833, 0xC6368183, 0x74165D93, 0x49767423, 0x0ED60EF3, 0x33B62743,
+		0xD1062710, 0xEC660EA0, 0xABC67470, 0x96A65DC0, 0x248681D0, 0x19E6A860, 0x5E46D2B0, 0x6326FB00,
+		0xE1766CD1, 0xDC164561, 0x9BB63FB1, 0xA6D61601, 0x14F6CA11, 0x2996E3A1, 0x6E369971, 0x5356B0C1,
+		0x70279F96, 0x4D47B626, 0x0AE7CCF6, 0x3787E546, 0x85A73956, 0xB8C710E6, 0xFF676A36, 0xC2074386,
+		0x4057D457, 0x7D37FDE7, 0x3A978737, 0x07F7AE87, 0xB5D77297, 0x88B75B27, 0xCF1721F7, 0xF2770847,
+		0x10C70814, 0x2DA721A4, 0x6A075B74, 0x576772C4, 0xE547AED4, 0xD8278764, 0x9F87FDB4, 0xA2E7D404,
+		0x20B743D5, 0x1DD76A65, 0x5A7710B5, 0x67173905, 0xD537E515, 0xE857CCA5, 0xAFF7B675, 0x92979FC5,
+		0xE915E8DB, 0xD475C16B, 0x93D5BBBB, 0xAEB5920B, 0x1C954E1B, 0x21F567AB, 0x66551D7B, 0x5B3534CB,
+		0xD965A31A, 0xE4058AAA, 0xA3A5F07A, 0x9EC5D9CA, 0x2CE505DA, 0x11852C6A, 0x562556BA, 0x6B457F0A,
+		0x89F57F59, 0xB49556E9, 0xF3352C39, 0xCE550589, 0x7C75D999, 0x4115F029, 0x06B58AF9, 0x3BD5A349,
+		0xB9853498, 0x84E51D28, 0xC34567F8, 0xFE254E48, 0x4C059258, 0x7165BBE8, 0x36C5C138, 0x0BA5E888,
+		0x28D4C7DF, 0x15B4EE6F, 0x521494BF, 0x6F74BD0F, 0xDD54611F, 0xE03448AF, 0xA794327F, 0x9AF41BCF,
+		0x18A48C1E, 0x25C4A5AE, 0x6264DF7E, 0x5F04F6CE, 0xED242ADE, 0xD044036E, 0x97E479BE, 0xAA84500E,
+		0x4834505D, 0x755479ED, 0x32F4033D, 0x0F942A8D, 0xBDB4F69D, 0x80D4DF2D, 0xC774A5FD, 0xFA148C4D,
+		0x78441B9C, 0x4524322C, 0x028448FC, 0x3FE4614C, 0x8DC4BD5C, 0xB0A494EC, 0xF704EE3C, 0xCA64C78C,
+	},
+	{
+		0x00000000, 0xCB5CD3A5, 0x4DC8A10B, 0x869472AE, 0x9B914216, 0x50CD91B3, 0xD659E31D, 0x1D0530B8,
+		0xEC53826D, 0x270F51C8, 0xA19B2366, 0x6AC7F0C3, 0x77C2C07B, 0xBC9E13DE, 0x3A0A6170, 0xF156B2D5,
+		0x03D6029B, 0xC88AD13E, 0x4E1EA390, 0x85427035, 0x9847408D, 0x531B9328, 0xD58FE186, 0x1ED33223,
+		0xEF8580F6, 0x24D95353, 0xA24D21FD, 0x6911F258, 0x7414C2E0, 0xBF481145, 0x39DC63EB, 0xF280B04E,
+		0x07AC0536, 0xCCF0D693, 0x4A64A43D, 0x81387798, 0x9C3D4720, 0x57619485, 0xD1F5E62B, 0x1AA9358E,
+		0xEBFF875B, 0x20A354FE, 0xA6372650, 0x6D6BF5F5, 0x706EC54D, 0xBB3216E8, 0x3DA66446, 0xF6FAB7E3,
+		0x047A07AD, 0xCF26D408, 0x49B2A6A6, 0x82EE7503, 0x9FEB45BB, 0x54B7961E, 0xD223E4B0, 0x197F3715,
+		0xE82985C0, 0x23755665, 0xA5E124CB, 0x6EBDF76E, 0x73B8C7D6, 0xB8E41473, 0x3E7066DD, 0xF52CB578,
+		0x0F580A6C, 0xC404D9C9, 0x4290AB67, 0x89CC78C2, 0x94C9487A, 0x5F959BDF, 0xD901E971, 0x125D3AD4,
+		0xE30B8801, 0x28575BA4, 0xAEC3290A, 0x659FFAAF, 0x789ACA17, 0xB3C619B2, 0x35526B1C, 0xFE0EB8B9,
+		0x0C8E08F7, 0xC7D2DB52, 0x4146A9FC, 0x8A1A7A59, 0x971F4AE1, 0x5C439944, 0xDAD7EBEA, 0x118B384F,
+		0xE0DD8A9A, 0x2B81593F, 0xAD152B91, 0x6649F834, 0x7B4CC88C, 0xB0101B29, 0x36846987, 0xFDD8BA22,
+		0x08F40F5A, 0xC3A8DCFF, 0x453CAE51, 0x8E607DF4, 0x93654D4C, 0x58399EE9, 0xDEADEC47, 0x15F13FE2,
+		0xE4A78D37, 0x2FFB5E92, 0xA96F2C3C, 0x6233FF99, 0x7F36CF21, 0xB46A1C84, 0x32FE6E2A, 0xF9A2BD8F,
+		0x0B220DC1, 0xC07EDE64, 0x46EAACCA, 0x8DB67F6F, 0x90B34FD7, 0x5BEF9C72, 0xDD7BEEDC, 0x16273D79,
+		0xE7718FAC, 0x2C2D5C09, 0xAAB92EA7, 0x61E5FD02, 0x7CE0CDBA, 0xB7BC1E1F, 0x31286CB1, 0xFA74BF14,
+		0x1EB014D8, 0xD5ECC77D, 0x5378B5D3, 0x98246676, 0x852156CE, 0x4E7D856B, 0xC8E9F7C5, 0x03B52460,
+		0xF2E396B5, 0x39BF4510, 0xBF2B37BE, 0x7477E41B, 0x6972D4A3, 0xA22E0706, 0x24BA75A8, 0xEFE6A60D,
+		0x1D661643, 0xD63AC5E6, 0x50AEB748, 0x9BF264ED, 0x86F75455, 0x4DAB87F0, 0xCB3FF55E, 0x006326FB,
+		0xF135942E, 0x3A69478B, 0xBCFD3525, 0x77A1E680, 0x6AA4D638, 0xA1F8059D, 0x276C7733, 0xEC30A496,
+		0x191C11EE, 0xD240C24B, 0x54D4B0E5, 0x9F886340, 0x828D53F8, 0x49D1805D, 0xCF45F2F3, 0x04192156,
+		0xF54F9383, 0x3E134026, 0xB8873288, 0x73DBE12D, 0x6EDED195, 0xA5820230, 0x2316709E, 0xE84AA33B,
+		0x1ACA1375, 0xD196C0D0, 0x5702B27E, 0x9C5E61DB, 0x815B5163, 0x4A0782C6, 0xCC93F068, 0x07CF23CD,
+		0xF6999118, 0x3DC542BD, 0xBB513013, 0x700DE3B6, 0x6D08D30E, 0xA65400AB, 0x20C07205, 0xEB9CA1A0,
+		0x11E81EB4, 0xDAB4CD11, 0x5C20BFBF, 0x977C6C1A, 0x8A795CA2, 0x41258F07, 0xC7B1FDA9, 0x0CED2E0C,
+		0xFDBB9CD9, 0x36E74F7C, 0xB0733DD2, 0x7B2FEE77, 0x662ADECF, 0xAD760D6A, 0x2BE27FC4, 0xE0BEAC61,
+		0x123E1C2F, 0xD962CF8A, 0x5FF6BD24, 0x94AA6E81, 0x89AF5E39, 0x42F38D9C, 0xC467FF32, 0x0F3B2C97,
+		0xFE6D9E42, 0x35314DE7, 0xB3A53F49, 0x78F9ECEC, 0x65FCDC54, 0xAEA00FF1, 0x28347D5F, 0xE368AEFA,
+		0x16441B82, 0xDD18C827, 0x5B8CBA89, 0x90D0692C, 0x8DD55994, 0x46898A31, 0xC01DF89F, 0x0B412B3A,
+		0xFA1799EF, 0x314B4A4A, 0xB7DF38E4, 0x7C83EB41, 0x6186DBF9, 0xAADA085C, 0x2C4E7AF2, 0xE712A957,
+		0x15921919, 0xDECECABC, 0x585AB812, 0x93066BB7, 0x8E035B0F, 0x455F88AA, 0xC3CBFA04, 0x089729A1,
+		0xF9C19B74, 0x329D48D1, 0xB4093A7F, 0x7F55E9DA, 0x6250D962, 0xA90C0AC7, 0x2F987869, 0xE4C4ABCC,
+	},
+	{
+		0x00000000, 0xA6770BB4, 0x979F1129, 0x31E81A9D, 0xF44F2413, 0x52382FA7, 0x63D0353A, 0xC5A73E8E,
+		0x33EF4E67, 0x959845D3, 0xA4705F4E, 0x020754FA, 0xC7A06A74, 0x61D761C0, 0x503F7B5D, 0xF64870E9,
+		0x67DE9CCE, 0xC1A9977A, 0xF0418DE7, 0x56368653, 0x9391B8DD, 0x35E6B369, 0x040EA9F4, 0xA279A240,
+		0x5431D2A9, 0xF246D91D, 0xC3AEC380, 0x65D9C834, 0xA07EF6BA, 0x0609FD0E, 0x37E1E793, 0x9196EC27,
+		0xCFBD399C, 0x69CA3228, 0x582228B5, 0xFE552301, 0x3BF21D8F, 0x9D85163B, 0xAC6D0CA6, 0x0A1A0712,
+		0xFC5277FB, 0x5A257C4F, 0x6BCD66D2, 0xCDBA6D66, 0x081D53E8, 0xAE6A585C, 0x9F8242C1, 0x39F54975,
+		0xA863A552, 0x0E14AEE6, 0x3FFCB47B, 0x998BBFCF, 0x5C2C8141, 0xFA5B8AF5, 0xCBB39068, 0x6DC49BDC,
+		0x9B8CEB35, 0x3DFBE081, 0x0C13FA1C, 0xAA64F1A8, 0x6FC3CF26, 0xC9B4C492, 0xF85CDE0F, 0x5E2BD5BB,
+		0x440B7579, 0xE27C7ECD, 0xD3946450, 0x75E36FE4, 0xB044516A, 0x16335ADE, 0x27DB4043, 0x81AC4BF7,
+		0x77E43B1E, 0xD19330AA, 0xE07B2A37, 0x460C2183, 0x83AB1F0D, 0x25DC14B9, 0x14340E24, 0xB2430590,
+		0x23D5E9B7, 0x85A2E203, 0xB44AF89E, 0x123DF32A, 0xD79ACDA4, 0x71EDC610, 0x4005DC8D, 0xE672D739,
+		0x103AA7D0, 0xB64DAC64, 0x87A5B6F9, 0x21D2BD4D, 0xE47583C3, 0x42028877, 0x73EA92EA, 0xD59D995E,
+		0x8BB64CE5, 0x2DC14751, 0x1C295DCC, 0xBA5E5678, 0x7FF968F6, 0xD98E6342, 0xE86679DF, 0x4E11726B,
+		0xB8590282, 0x1E2E0936, 0x2FC613AB, 0x89B1181F, 0x4C162691, 0xEA612D25, 0xDB8937B8, 0x7DFE3C0C,
+		0xEC68D02B, 0x4A1FDB9F, 0x7BF7C102, 0xDD80CAB6, 0x1827F438, 0xBE50FF8C, 0x8FB8E511, 0x29CFEEA5,
+		0xDF879E4C, 0x79F095F8, 0x48188F65, 0xEE6F84D1, 0x2BC8BA5F, 0x8DBFB1EB, 0xBC57AB76, 0x1A20A0C2,
+		0x8816EAF2, 0x2E61E146, 0x1F89FBDB, 0xB9FEF06F, 0x7C59CEE1, 0xDA2EC555, 0xEBC6DFC8, 0x4DB1D47C,
+		0xBBF9A495, 0x1D8EAF21, 0x2C66B5BC, 0x8A11BE08, 0x4FB68086, 0xE9C18B32, 0xD82991AF, 0x7E5E9A1B,
+		0xEFC8763C, 0x49BF7D88, 0x78576715, 0xDE206CA1, 0x1B87522F, 0xBDF0599B, 0x8C184306, 0x2A6F48B2,
+		0xDC27385B, 0x7A5033EF, 0x4BB82972, 0xEDCF22C6, 0x28681C48, 0x8E1F17FC, 0xBFF70D61, 0x198006D5,
+		0x47ABD36E, 0xE1DCD8DA, 0xD034C247, 0x7643C9F3, 0xB3E4F77D, 0x1593FCC9, 0x247BE654, 0x820CEDE0,
+		0x74449D09, 0xD23396BD, 0xE3DB8C20, 0x45AC8794, 0x800BB91A, 0x267CB2AE, 0x1794A833, 0xB1E3A387,
+		0x20754FA0, 0x86024414, 0xB7EA5E89, 0x119D553D, 0xD43A6BB3, 0x724D6007, 0x43A57A9A, 0xE5D2712E,
+		0x139A01C7, 0xB5ED0A73, 0x840510EE, 0x22721B5A, 0xE7D525D4, 0x41A22E60, 0x704A34FD, 0xD63D3F49,
+		0xCC1D9F8B, 0x6A6A943F, 0x5B828EA2, 0xFDF58516, 0x3852BB98, 0x9E25B02C, 0xAFCDAAB1, 0x09BAA105,
+		0xFFF2D1EC, 0x5985DA58, 0x686DC0C5, 0xCE1ACB71, 0x0BBDF5FF, 0xADCAFE4B, 0x9C22E4D6, 0x3A55EF62,
+		0xABC30345, 0x0DB408F1, 0x3C5C126C, 0x9A2B19D8, 0x5F8C2756, 0xF9FB2CE2, 0xC813367F, 0x6E643DCB,
+		0x982C4D22, 0x3E5B4696, 0x0FB35C0B, 0xA9C457BF, 0x6C636931, 0xCA146285, 0xFBFC7818, 0x5D8B73AC,
+		0x03A0A617, 0xA5D7ADA3, 0x943FB73E, 0x3248BC8A, 0xF7EF8204, 0x519889B0, 0x6070932D, 0xC6079899,
+		0x304FE870, 0x9638E3C4, 0xA7D0F959, 0x01A7F2ED, 0xC400CC63, 0x6277C7D7, 0x539FDD4A, 0xF5E8D6FE,
+		0x647E3AD9, 0xC209316D, 0xF3E12BF0, 0x55962044, 0x90311ECA, 0x3646157E, 0x07AE0FE3, 0xA1D90457,
+		0x579174BE, 0xF1E67F0A, 0xC00E6597, 0x66796E23, 0xA3DE50AD, 0x05A95B19, 0x34414184, 0x92364A30,
+	},
+	{
+		0x00000000, 0xCCAA009E, 0x4225077D, 0x8E8F07E3, 0x844A0EFA, 0x48E00E64, 0xC66F0987, 0x0AC50919,
+		0xD3E51BB5, 0x1F4F1B2B, 0x91C01CC8, 0x5D6A1C56, 0x57AF154F, 0x9B0515D1, 0x158A1232, 0xD92012AC,
+		0x7CBB312B, 0xB01131B5, 0x3E9E3656, 0xF23436C8, 0xF8F13FD1, 0x345B3F4F, 0xBAD438AC, 0x767E3832,
+		0xAF5E2A9E, 0x63F42A00, 0xED7B2DE3, 0x21D12D7D, 0x2B142464, 0xE7BE24FA, 0x69312319, 0xA59B2387,
+		0xF9766256, 0x35DC62C8, 0xBB53652B, 0x77F965B5, 0x7D3C6CAC, 0xB1966C32, 0x3F196BD1, 0xF3B36B4F,
+		0x2A9379E3, 0xE639797D, 0x68B67E9E, 0xA41C7E00, 0xAED97719, 0x62737787, 0xECFC7064, 0x205670FA,
+		0x85CD537D, 0x496753E3, 0xC7E85400, 0x0B42549E, 0x01875D87, 0xCD2D5D19, 0x43A25AFA, 0x8F085A64,
+		0x562848C8, 0x9A824856, 0x140D4FB5, 0xD8A74F2B, 0xD2624632, 0x1EC846AC, 0x9047414F, 0x5CED41D1,
+		0x299DC2ED, 0xE537C273, 0x6BB8C590, 0xA712C50E, 0xADD7CC17, 0x617DCC89, 0xEFF2CB6A, 0x2358CBF4,
+		0xFA78D958, 0x36D2D9C6, 0xB85DDE25, 0x74F7DEBB, 0x7E32D7A2, 0xB298D73C, 0x3C17D0DF, 0xF0BDD041,
+		0x5526F3C6, 0x998CF358, 0x1703F4BB, 0xDBA9F425, 0xD16CFD3C, 0x1DC6FDA2, 0x9349FA41, 0x5FE3FADF,
+		0x86C3E873, 0x4A69E8ED, 0xC4E6EF0E, 0x084CEF90, 0x0289E689, 0xCE23E617, 0x40ACE1F4, 0x8C06E16A,
+		0xD0EBA0BB, 0x1C41A025, 0x92CEA7C6, 0x5E64A758, 0x54A1AE41, 0x980BAEDF, 0x1684A93C, 0xDA2EA9A2,
+		0x030EBB0E, 0xCFA4BB90, 0x412BBC73, 0x8D81BCED, 0x8744B5F4, 0x4BEEB56A, 0xC561B289, 0x09CBB217,
+		0xAC509190, 0x60FA910E, 0xEE7596ED, 0x22DF9673, 0x281A9F6A, 0xE4B09FF4, 0x6A3F9817, 0xA6959889,
+		0x7FB58A25, 0xB31F8ABB, 0x3D908D58, 0xF13A8DC6, 0xFBFF84DF, 0x37558441, 0xB9DA83A2, 0x7570833C,
+		0x533B85DA, 0x9F918544, 0x111E82A7, 0xDDB48239, 0xD7718B20, 0x1BDB8BBE, 0x95548C5D, 0x59FE8CC3,
+		0x80DE9E6F, 0x4C749EF1, 0xC2FB9912, 0x0E51998C, 0x04949095, 0xC83E900B, 0x46B197E8, 0x8A1B9776,
+		0x2F80B4F1, 0xE32AB46F, 0x6DA5B38C, 0xA10FB312, 0xABCABA0B, 0x6760BA95, 0xE9EFBD76, 0x2545BDE8,
+		0xFC65AF44, 0x30CFAFDA, 0xBE40A839, 0x72EAA8A7, 0x782FA1BE, 0xB485A120, 0x3A0AA6C3, 0xF6A0A65D,
+		0xAA4DE78C, 0x66E7E712, 0xE868E0F1, 0x24C2E06F, 0x2E07E976, 0xE2ADE9E8, 0x6C22EE0B, 0xA088EE95,
+		0x79A8FC39, 0xB502FCA7, 0x3B8DFB44, 0xF727FBDA, 0xFDE2F2C3, 0x3148F25D, 0xBFC7F5BE, 0x736DF520,
+		0xD6F6D6A7, 0x1A5CD639, 0x94D3D1DA, 0x5879D144, 0x52BCD85D, 0x9E16D8C3, 0x1099DF20, 0xDC33DFBE,
+		0x0513CD12, 0xC9B9CD8C, 0x4736CA6F, 0x8B9CCAF1, 0x8159C3E8, 0x4DF3C376, 0xC37CC495, 0x0FD6C40B,
+		0x7AA64737, 0xB60C47A9, 0x3883404A, 0xF42940D4, 0xFEEC49CD, 0x32464953, 0xBCC94EB0, 0x70634E2E,
+		0xA9435C82, 0x65E95C1C, 0xEB665BFF, 0x27CC5B61, 0x2D095278, 0xE1A352E6, 0x6F2C5505, 0xA386559B,
+		0x061D761C, 0xCAB77682, 0x44387161, 0x889271FF, 0x825778E6, 0x4EFD7878, 0xC0727F9B, 0x0CD87F05,
+		0xD5F86DA9, 0x19526D37, 0x97DD6AD4, 0x5B776A4A, 0x51B26353, 0x9D1863CD, 0x1397642E, 0xDF3D64B0,
+		0x83D02561, 0x4F7A25FF, 0xC1F5221C, 0x0D5F2282, 0x079A2B9B, 0xCB302B05, 0x45BF2CE6, 0x89152C78,
+		0x50353ED4, 0x9C9F3E4A, 0x121039A9, 0xDEBA3937, 0xD47F302E, 0x18D530B0, 0x965A3753, 0x5AF037CD,
+		0xFF6B144A, 0x33C114D4, 0xBD4E1337, 0x71E413A9, 0x7B211AB0, 0xB78B1A2E, 0x39041DCD, 0xF5AE1D53,
+		0x2C8E0FFF, 0xE0240F61, 0x6EAB0882, 0xA201081C, 0xA8C40105, 0x646E019B, 0xEAE10678, 0x264B06E6,
+	},
+};
+
+/**
+ * a little endian word at any alignment, the compiler merges the loads into a single LDR (the M4 allows unaligned LDR)
+ * while memcpy would stay a call in a file built with -fno-builtin
+ */
+static inline uint32_t prvLoadWord(const uint8_t* bytes)
+{
+	return (uint32_t)bytes[0] | ((uint32_t)bytes[1] << 8) | ((uint32_t)bytes[2] << 16) | ((uint32_t)bytes[3] << 24);
+}
+
+/**
+ * update a CRC-32 with more data, start with crc = 0
+ */
+static uint32_t prvCrc32(uint32_t crc, const void* data, uint32_t length)
+{
+	const uint8_t* bytes = data;
+	crc = ~crc;
+	while (length >= 8)
+	{
+		uint32_t low = prvLoadWord(bytes) ^ crc;
+		uint32_t high = prvLoadWord(bytes + 4);
+		crc = crc32Table[7][low & 0xFF] ^ crc32Table[6][(low >> 8) & 0xFF] ^
+		      crc32Table[5][(low >> 16) & 0xFF] ^ crc32Table[4][low >> 24] ^
+		      crc32Table[3][high & 0xFF] ^ crc32Table[2][(high >> 8) & 0xFF] ^
+		      crc32Table[1][(high >> 16) & 0xFF] ^ crc32Table[0][high >> 24];
+		bytes += 8;
+		length -= 8;
+	}
+	while (length--)
+		crc = (crc >> 8) ^ crc32Table[0][(crc ^ *bytes++) & 0xFF];
+	return ~crc;
+}
+
+#else
+#error "unknown HARDFAULT_CRC_ENGINE"
+#endif
+
+// --------------------------------------------------------------------------------------
+
+static uint32_t hardFault_nextSequence; // the sequence number of the next dump, restored by hardFault_init
+static bool hardFault_dumpSaved;        // a slot holds a dump, the sequence number alone can't tell once it wrapped
+
+static inline uint32_t prvSlotAddress(uint32_t sequence)
+{
+	return ERROR_HANDELING_MEMORY_ADDRESS + (sequence % HARDFAULT_SLOT_COUNT) * HARDFAULT_SLOT_SIZE;
+}
+
+/**
+ * read and validate the header of a slot, this doesn't check the dump itself
+ * return - true: the slot holds a complete dump, false: the slot is empty or corrupted
+ */
+static bool prvReadSlotHeader(uint32_t slotAddress, dump_header_t* header)
+{
+	memory_read(slotAddress, header, sizeof(dump_header_t));
+	return header->magic == DUMP_MAGIC &&
+	       header->version == DUMP_FORMAT_VERSION &&
+	       header->headerSize == sizeof(dump_header_t) &&
+	       header->length <= HARDFAULT_SLOT_SIZE - HARDFAULT_SLOT_HEADER_SIZE &&
+	       header->headerCrc == prvCrc32(0, header, offsetof(dump_header_t, headerCrc));
+}
+
+/**
+ * must be called once at boot, before a hardfault can be saved or read
+ * finds the newest saved dump so the handler can pick the next slot without scanning
+ */
+void hardFault_init(void)
+{
+	bool found = false;
+	uint32_t newest = 0;
+	for (uint32_t slot = 0; slot < HARDFAULT_SLOT_COUNT; slot++)
+	{
+		dump_header_t header;
+		if (!prvReadSlotHeader(ERROR_HANDELING_MEMORY_ADDRESS + slot * HARDFAULT_SLOT_SIZE, &header) ||
+		    header.sequence % HARDFAULT_SLOT_COUNT != slot)
+			continue;
+		if (!found || (int32_t)(header.sequence - newest) > 0)
+			newest = header.sequence;
+		found = true;
+	}
+	hardFault_nextSequence = found ? newest + 1 : 0;
+	hardFault_dumpSaved = found;
+
+#if HARDFAULT_HANDLE_CONFIGURABLE_FAULTS && !defined(HARDFAULT_HOST_SIM)
+	SCB->SHCSR |= SCB_SHCSR_MEMFAULTENA_Msk | SCB_SHCSR_BUSFAULTENA_Msk | SCB_SHCSR_USGFAULTENA_Msk;
+#endif
+}
+
+void hardFault_dumpIteratorInit(hardFault_dumpIterator_t* iterator)
+{
+	iterator->nextSequence = hardFault_nextSequence - 1;
+	/* the slots that never held a dump, or hold an older one, are skipped by their header */
+	iterator->remaining = hardFault_dumpSaved ? HARDFAULT_SLOT_COUNT : 0;
+	iterator->sequence = 0;
+	iterator->length = 0;
+	iterator->flags = 0;
+	iterator->faultSource = 0;
+}
+
+/**
+ * find the next saved dump without reading it
+ * cursor - set to the start of the dump, read it with hardFault_dumpCursorRead or hardFault_dumpCursorSpan
+ * return - true: found a dump, false: no more dumps exist
+ */
+bool hardFault_dumpIteratorNextCursor(hardFault_dumpIterator_t* iterator, hardFault_dumpCursor_t* cursor)
+{
+	while (iterator->remaining > 0)
+	{
+		uint32_t sequence = iterator->nextSequence--;
+		iterator->remaining--;
+
+		dump_header_t header;
+		if (!prvReadSlotHeader(prvSlotAddress(sequence), &header) || header.sequence != sequence)
+			continue;
+
+		cursor->address = prvSlotAddress(sequence) + HARDFAULT_SLOT_HEADER_SIZE;
+		cursor->remaining = header.length;
+		cursor->crc = 0;
+		cursor->dataCrc = header.dataCrc;
+		iterator->sequence = sequence;
+		iterator->length = header.length;
+		iterator->flags = header.flags;
+		iterator->faultSource = header.faultSource;
+		return true;
+	}
+	return false;
+}
+
+/**
+ * copy the next part of the dump
+ * return - the number of bytes copied to buffer, 0 at the end of the dump
+ */
+uint32_t hardFault_dumpCursorRead(hardFault_dumpCursor_t* cursor, void* buffer, uint32_t bufferSize)
+{
+	uint32_t length = MIN(bufferSize, cursor->remaining);
+	memory_read(cursor->address, buffer, length);
+	cursor->crc = prvCrc32(cursor->crc, buffer, length);
+	cursor->address += length;
+	cursor->remaining -= length;
+	return length;
+}
+
+#if HARDFAULT_STORAGE_MEMORY_MAPPED
+/**
+ * get the next part of the dump without copying it, for storage the CPU can read directly
+ * length - the length of the returned part, up to maxLength, 0 at the end of the dump
+ * return - a pointer into the storage
+ */
+const void* hardFault_dumpCursorSpan(hardFault_dumpCursor_t* cursor, uint32_t maxLength, uint32_t* length)
+{
+	const uint8_t* span = STORAGE_PTR(cursor->address);
+	*length = MIN(maxLength, cursor->remaining);
+	cursor->crc = prvCrc32(cursor->crc, span, *length);
+	cursor->address += *length;
+	cursor->remaining -= *length;
+	return span;
+}
+#endif
+
+/**
+ * return - true if the whole dump was read and it matches its CRC
+ */
+bool hardFault_dumpCursorValid(const hardFault_dumpCursor_t* cursor)
+{
+	return cursor->remaining == 0 && cursor->crc == cursor->dataCrc;
+}
+
+/**
+ * walk a table in the format of DUMP_FLAG_SECTIONS (DUMP_FLAG_REGIONS), to find what follows it in a dump
+ * return - the length of the table including the sections, 0 if it's longer than length
+ */
+uint32_t hardFault_sectionTableLength(const uint8_t* table, uint32_t length)
+{
+	uint32_t count;
+	if (length < sizeof(count))
+		return 0;
+	memcpy(&count, table, sizeof(count));
+	if (count > (length - sizeof(count)) / sizeof(dump_section_t))
+		return 0;
+
+	uint32_t tableLength = sizeof(count) + count * sizeof(dump_section_t);
+	for (uint32_t i = 0; i < count; i++)
+	{
+		dump_section_t section;
+		memcpy(&section, table + sizeof(count) + i * sizeof(dump_section_t), sizeof(section));
+		if (section.length > length - tableLength)
+			return 0;
+		tableLength += section.length;
+	}
+	return tableLength;
+}
+
+#if HARDFAULT_STORAGE_MEMORY_MAPPED
+/**
+ * make a view of the next saved dump, dumps that fail the CRC check are skipped
+ * return - true: found a dump, false: no more dumps exist
  */
-#define ERROR_HANDELING_MEMORY_ADDRESS (PROG_RAM_END) // end of RAM allocated by the linker file
-#define ERROR_HANDELING_MEMORY_SIZE (RAM_END - PROG_RAM_END)
+bool hardFault_dumpIteratorNextView(hardFault_dumpIterator_t* iterator, hardFault_dumpView_t* view)
+{
+	hardFault_dumpCursor_t cursor;
+	while (hardFault_dumpIteratorNextCursor(iterator, &cursor))
+	{
+		uint32_t length;
+		const uint8_t* dump = hardFault_dumpCursorSpan(&cursor, cursor.remaining, &length);
+		if (!hardFault_dumpCursorValid(&cursor) || length < sizeof(core_dump_t))
+			continue;
 
-void memory_erase(uint32_t address, uint32_t length)
+		const core_dump_t* core_dump = (const core_dump_t*)dump;
+		view->header = (const dump_header_t*)STORAGE_PTR(prvSlotAddress(iterator->sequence));
+		view->SCB_registers = &core_dump->SCB_registers;
+		view->extended_registers = &core_dump->extended_registers;
+		view->core_registers = &core_dump->core_registers;
+		view->fpu_registers = NULL;
+		view->backtrace = NULL;
+		view->regions = NULL;
+		view->regionsLength = 0;
+		view->context_stack = core_dump->context_stack;
+		view->contextStackLength = length - sizeof(core_dump_t);
+		if ((iterator->flags & DUMP_FLAG_FPU) && view->contextStackLength >= sizeof(fpu_registers_t))
+		{
+			view->fpu_registers = (const fpu_registers_t*)view->context_stack;
+			view->context_stack += sizeof(fpu_registers_t);
+			view->contextStackLength -= sizeof(fpu_registers_t);
+		}
+		if ((iterator->flags & DUMP_FLAG_BACKTRACE) && view->contextStackLength >= sizeof(backtrace_t))
+		{
+			const backtrace_t* backtrace = (const backtrace_t*)view->context_stack;
+			uint32_t backtraceLength = sizeof(backtrace_t) + backtrace->depth * sizeof(uint32_t);
+			if (backtrace->depth <= HARDFAULT_BACKTRACE_DEPTH && backtraceLength <= view->contextStackLength)
+			{
+				view->backtrace = backtrace;
+				view->context_stack += backtraceLength;
+				view->contextStackLength -= backtraceLength;
+			}
+		}
+		if ((iterator->flags & DUMP_FLAG_REGIONS) && view->contextStackLength >= sizeof(uint32_t))
+		{
+			uint32_t regionsLength = hardFault_sectionTableLength(view->context_stack, view->contextStackLength);
+			if (regionsLength > 0)
+			{
+				view->regions = view->context_stack;
+				view->regionsLength = regionsLength;
+				view->context_stack += regionsLength;
+				view->contextStackLength -= regionsLength;
+			}
+		}
+		return true;
+	}
+	return false;
+}
+
+/**
+ * return - true if the fault happened while stacking the exception frame, usually a stack overflow
+ */
+bool hardFault_dumpViewIsStackingError(const hardFault_dumpView_t* view)
 {
-	memset((void*)address, 0, length);
+	return (view->SCB_registers->CFSR & (CFSR_MSTKERR | CFSR_STKERR)) != 0;
 }
+#endif
 
-void memory_write(uint32_t address, const void* data, uint32_t length)
+/**
+ * read the next saved dump, dumps that fail the CRC check are skipped
+ * buffer - the data will be returned in a format of core_dump_t, truncated to bufferSize
+ * return - true: read successfull, false: no more dumps exist
+ */
+bool hardFault_dumpIteratorNext(hardFault_dumpIterator_t* iterator, void* buffer, uint32_t bufferSize)
 {
-	memcpy((void*)address, data, length);
+	hardFault_dumpCursor_t cursor;
+	while (hardFault_dumpIteratorNextCursor(iterator, &cursor))
+	{
+		hardFault_dumpCursorRead(&cursor, buffer, bufferSize);
+		/* the part that doesn't fit in the buffer still has to be checked */
+		uint8_t chunk[64];
+		while (hardFault_dumpCursorRead(&cursor, chunk, sizeof(chunk)) > 0)
+			;
+		if (hardFault_dumpCursorValid(&cursor))
+			return true;
+	}
+	return false;
 }
 
-void memory_read(uint32_t address, void* data, uint32_t length)
+/**
+ * decode a context stack saved with DUMP_FLAG_STACK_RLE
+ * The encoding is made of 32bit words, each word is a stack word.
+ * When the same word appears twice in a row, the word following them is the number of additional repetitions.
+ * encoded - the context_stack of the dump, encodedLength - its length in bytes
+ * return - the number of bytes written to stack, truncated to stackSize
+ */
+uint32_t hardFault_decodeStack(const void* encoded, uint32_t encodedLength, void* stack, uint32_t stackSize)
 {
-	memcpy(data, (void*)address, length);
+	const uint8_t* in = encoded;
+	uint8_t* out = stack;
+	uint32_t inWords = encodedLength / sizeof(uint32_t);
+	uint32_t outWords = stackSize / sizeof(uint32_t);
+	uint32_t written = 0;
+	uint32_t previous = 0;
+	bool havePrevious = false;
+
+	for (uint32_t i = 0; i < inWords && written < outWords; i++)
+	{
+		uint32_t word;
+		memcpy(&word, &in[i * sizeof(uint32_t)], sizeof(word));
+		memcpy(&out[written++ * sizeof(uint32_t)], &word, sizeof(word));
+
+		if (havePrevious && word == previous && i + 1 < inWords)
+		{
+			uint32_t repeats;
+			memcpy(&repeats, &in[++i * sizeof(uint32_t)], sizeof(repeats));
+			for (; repeats > 0 && written < outWords; repeats--)
+				memcpy(&out[written++ * sizeof(uint32_t)], &word, sizeof(word));
+			havePrevious = false;
+		}
+		else
+		{
+			previous = word;
+			havePrevious = true;
+		}
+	}
+	return written * sizeof(uint32_t);
 }
 
 
 /**
- * The SCB registers in the order they are defined in core_cm4.h
+ * erase all the saved hardfault data
  */
-typedef struct __attribute__((__packed__)) SCB_registers_t {
-	uint32_t CFSR;
-	uint32_t HFSR;
-	uint32_t DFSR;
-	uint32_t MMFAR;
-	uint32_t BFAR;
-	uint32_t AFSR;
-}SCB_registers_t;
+void hardFault_eraseSavedData(void)
+{
+	memory_erase(ERROR_HANDELING_MEMORY_ADDRESS, HARDFAULT_SLOT_COUNT * HARDFAULT_SLOT_SIZE);
+	hardFault_nextSequence = 0;
+	hardFault_dumpSaved = false;
+}
 
-typedef struct __attribute__((__packed__)) core_registers_t {
-	uint32_t R0;
-	uint32_t R1;
-	uint32_t R2;
-	uint32_t R3;
-	uint32_t R12;
-	uint32_t LR;
-	uint32_t PC;
-	uint32_t PSR;
-}core_registers_t;
+// --------------------------------------------------------------------------------------
 
 /**
- * the dump will be saved to the memory in the following format
+ * tracks the write position of the dump inside the reserved region
  */
-typedef struct __attribute__((__packed__)) core_dump_t {
-	SCB_registers_t SCB_registers;
-	core_registers_t core_registers;
-	uint8_t  context_stack[];
-}core_dump_t;
+typedef struct dump_writer_t {
+	uint32_t address;
+	uint32_t end;
+	uint32_t erasedEnd; // everything below this address was already erased during this capture
+	uint32_t crc;       // CRC of everything written so far
+}dump_writer_t;
 
-// --------------------------------------------------------------------------------------
-static inline uint32_t getMainStackBase(void)
+/**
+ * make room for writing at the current position of the writer, erasing the storage if needed
+ * return - the number of bytes that can be written, truncated to the space left in the region
+ */
+static uint32_t prvDumpPrepare(dump_writer_t* writer, uint32_t length)
 {
-	extern uint32_t _estack[]; //stack start address definition in the linker file
-	return (uint32_t)_estack;
+	uint32_t NumOfbyteToWrite = MIN(length, writer->end - writer->address);
+
+#if HARDFAULT_ERASE_MODE == HARDFAULT_ERASE_INCREMENTAL
+	/* erase units are erased only once, the first time a write reaches them */
+	if (writer->address + NumOfbyteToWrite > writer->erasedEnd)
+	{
+		uint32_t eraseEnd = MIN(HARDFAULT_ALIGN_UP(writer->address + NumOfbyteToWrite, HARDFAULT_STORAGE_ERASE_UNIT), writer->end);
+		memory_erase(writer->erasedEnd, eraseEnd - writer->erasedEnd);
+		writer->erasedEnd = eraseEnd;
+	}
+#endif
+	return NumOfbyteToWrite;
 }
 
-static inline uint32_t getTaskStackBase(uint32_t sp)
+/**
+ * write the data at the current position of the writer and advance it
+ * the data is truncated if there isn't enough space left in the region
+ * return - the number of bytes written
+ */
+static uint32_t prvDumpWrite(dump_writer_t* writer, const void* data, uint32_t length)
 {
-	/* return the start of the stack of the last running task
-	 * can either use implementation for your own OS or even use a constant size like: sp + 1024*/
-	return sp +1024;
+	uint32_t NumOfbyteToWrite = prvDumpPrepare(writer, length);
+	memory_write(writer->address, data, NumOfbyteToWrite);
+	writer->crc = prvCrc32(writer->crc, data, NumOfbyteToWrite);
+	writer->address += NumOfbyteToWrite;
+	return NumOfbyteToWrite;
 }
 
-static inline uint32_t getStackBase(uint32_t sp)
+#if HARDFAULT_STACK_DMA
+/* device specific
+ * dma_copyStart starts a memory to memory copy and returns immediately,
+ * dma_waitDone waits for it to finish and returns false if the transfer failed */
+void dma_copyStart(uint32_t destination, const void* source, uint32_t length);
+bool dma_waitDone(void);
+
+#define PERIPHERAL_SPACE_START 0x40000000
+#define PERIPHERAL_SPACE_END   0x60000000
+#define CFSR_BFARVALID (1 << 15)
+
+/**
+ * a stack copy in progress
+ */
+typedef struct dma_stack_copy_t {
+	uint32_t destination;
+	const void* source;
+	uint32_t length;
+	bool started;
+}dma_stack_copy_t;
+
+/**
+ * start copying the stack with the DMA and compute its CRC meanwhile, the writer advances past the stack
+ * when the DMA can't be trusted the stack is copied by the CPU right away
+ */
+static void prvDumpWriteStackDma(dump_writer_t* writer, const void* stack, uint32_t length, dma_stack_copy_t* copy)
 {
-	/* The naked function does not pass the LR of the exception, instead of modifying it we'll uses another way to find the context.
-	 * The hardfault is running on the main context, so the PSP hasn't changed, it's current value is the same value as it was at the time of the violation.
-	 * This means that if the sp equals to the PSP, we are in a process context */
-	if (sp == __get_PSP())
-		return getTaskStackBase(sp);
+	uint32_t bfar = SCB->BFAR;
+	bool dmaSuspected = (SCB->CFSR & CFSR_BFARVALID) && bfar >= PERIPHERAL_SPACE_START && bfar < PERIPHERAL_SPACE_END;
+	if (dmaSuspected)
+	{
+		copy->started = false;
+		prvDumpWrite(writer, stack, length);
+		return;
+	}
+
+	copy->destination = writer->address;
+	copy->source = stack;
+	copy->length = prvDumpPrepare(writer, length);
+	copy->started = true;
+	dma_copyStart(copy->destination, copy->source, copy->length);
+
+	writer->crc = prvCrc32(writer->crc, stack, copy->length);
+	writer->address += copy->length;
+}
+
+/**
+ * wait for the DMA stack copy, and copy the stack with the CPU if the DMA failed
+ */
+static void prvDumpWaitStackDma(const dma_stack_copy_t* copy)
+{
+	if (copy->started && !dma_waitDone())
+		memory_write(copy->destination, copy->source, copy->length);
+}
+#endif
+
+#if HARDFAULT_STACK_RLE
+#define RLE_BUFFER_WORDS 16
+
+typedef struct rle_encoder_t {
+	dump_writer_t* writer;
+	uint32_t buffer[RLE_BUFFER_WORDS]; // the output is buffered to write in bursts
+	uint32_t buffered;
+	bool full; // the slot is out of space
+}rle_encoder_t;
+
+static inline void prvRleEmit(rle_encoder_t* encoder, uint32_t word)
+{
+	encoder->buffer[encoder->buffered++] = word;
+	if (encoder->buffered == RLE_BUFFER_WORDS)
+	{
+		encoder->full = prvDumpWrite(encoder->writer, encoder->buffer, sizeof(encoder->buffer)) < sizeof(encoder->buffer);
+		encoder->buffered = 0;
+	}
+}
+
+/**
+ * write the stack encoded as described in hardFault_decodeStack
+ * the encoder works one word at a time with a constant cost per word
+ */
+static void prvDumpWriteStackRle(dump_writer_t* writer, const uint32_t* stack, uint32_t words)
+{
+	rle_encoder_t encoder; // the buffer is written before it's read, leaving it uninitialised avoids a memset
+	encoder.writer = writer;
+	encoder.buffered = 0;
+	encoder.full = false;
+	uint32_t value = 0;
+	uint32_t emitted = 0; // how many times in a row value was emitted, after 2 the repetitions are counted
+	uint32_t repeats = 0;
+
+	for (uint32_t i = 0; i < words && !encoder.full; i++)
+	{
+		uint32_t word = stack[i];
+		if (emitted == 2)
+		{
+			if (word == value && repeats != UINT32_MAX)
+			{
+				repeats++;
+				continue;
+			}
+			prvRleEmit(&encoder, repeats);
+			emitted = 0;
+		}
+
+		emitted = (emitted == 1 && word == value) ? 2 : 1;
+		repeats = 0;
+		value = word;
+		prvRleEmit(&encoder, word);
+	}
+
+	if (emitted == 2 && !encoder.full)
+		prvRleEmit(&encoder, repeats);
+	if (!encoder.full)
+		prvDumpWrite(writer, encoder.buffer, encoder.buffered * sizeof(uint32_t));
+}
+#endif
+
+/**
+ * measures the cycles of the capture phases, does nothing without HARDFAULT_PHASE_TIMING
+ */
+typedef struct phase_timer_t {
+	uint32_t start;
+	uint32_t cycles[DUMP_PHASE_COUNT];
+}phase_timer_t;
+
+static inline uint32_t prvCycleCount(void)
+{
+#ifdef HARDFAULT_HOST_SIM
+	return hostSim_cycles;
+#else
+	return DWT->CYCCNT;
+#endif
+}
+
+static inline void prvPhaseTimerStart(phase_timer_t* timer)
+{
+#if HARDFAULT_PHASE_TIMING
+#ifndef HARDFAULT_HOST_SIM
+	/* the counter may not be running if no debugger is attached */
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+#endif
+	timer->start = prvCycleCount();
+#endif
+	(void)timer;
+}
+
+static inline void prvPhaseTimerEnd(phase_timer_t* timer, uint32_t phase)
+{
+#if HARDFAULT_PHASE_TIMING
+	uint32_t now = prvCycleCount();
+	timer->cycles[phase] = now - timer->start;
+	timer->start = now;
+#endif
+	(void)timer;
+	(void)phase;
+}
+
+#if HARDFAULT_CAPTURE_FPU
+/**
+ * save the FPU state of an extended exception frame
+ * return - the DUMP_FLAG_xxx of the saved registers
+ */
+static uint32_t prvDumpWriteFpu(dump_writer_t* writer, const uint32_t* pulFaultStackAddress)
+{
+	fpu_registers_t fpu_registers __attribute__((aligned(4)));
+	prvFaultSafeFill(&fpu_registers, 0, sizeof(fpu_registers));
+	uint32_t flags = DUMP_FLAG_FPU;
+
+	if (FPU->FPCCR & FPU_FPCCR_LSPACT_Msk)
+	{
+		/* lazy stacking: the frame space is reserved but S0-S15 are still in the FPU.
+		 * Clear LSPACT so reading them doesn't trigger the deferred save into a possibly broken stack */
+		FPU->FPCCR &= ~FPU_FPCCR_LSPACT_Msk;
+		SAVE_FPU_S0_S15(fpu_registers.S);
+		fpu_registers.FPSCR = __get_FPSCR();
+	}
 	else
-		return getMainStackBase();
+	{
+		/* the frame holds R0-R3, R12, LR, PC, PSR followed by S0-S15 and FPSCR */
+		prvFaultSafeCopy(fpu_registers.S, &pulFaultStackAddress[8], 16 * sizeof(uint32_t));
+		fpu_registers.FPSCR = pulFaultStackAddress[24];
+	}
+
+#if HARDFAULT_CAPTURE_FPU_HIGH_REGISTERS
+	SAVE_FPU_S16_S31(&fpu_registers.S[16]);
+	flags |= DUMP_FLAG_FPU_HIGH;
+#endif
+
+	prvDumpWrite(writer, &fpu_registers, sizeof(fpu_registers));
+	return flags;
 }
+#endif
 
-// --------------------------------------------------------------------------------------
+#if HARDFAULT_BACKTRACE != HARDFAULT_BACKTRACE_NONE
+#define EXC_FRAME_ALIGNED (1 << 9) // PSR bit set when the hardware aligned the exception frame with a padding word
+
+/**
+ * return - the sp of the violating context before the exception frame was pushed
+ */
+static inline uint32_t prvFrameEnd(const uint32_t* pulFaultStackAddress, uint32_t excReturn)
+{
+	uint32_t frameWords = (excReturn & EXC_RETURN_STANDARD_FRAME) ? 8 : 26;
+	if (pulFaultStackAddress[7] & EXC_FRAME_ALIGNED)
+		frameWords++;
+	return (uint32_t)(uintptr_t)pulFaultStackAddress + frameWords * sizeof(uint32_t);
+}
+#endif
+
+#if HARDFAULT_BACKTRACE == HARDFAULT_BACKTRACE_SCAN || HARDFAULT_STACK_TRUNCATION == HARDFAULT_TRUNCATE_COMPACT
+static hardFault_codeRange_t codeRanges[HARDFAULT_MAX_CODE_RANGES]; // sorted and not overlapping
+static uint32_t codeRangeCount;
 
 /**
- * read the last saved hardfault value if exist
- * buffer - the data will be returned in a format of core_dump_t
- * return - true: read successfull, false: no data exist
+ * set the code ranges for HARDFAULT_BACKTRACE_SCAN and HARDFAULT_TRUNCATE_COMPACT, at boot
+ * The ranges are sorted and merged here, so the handler only searches them.
+ * With the usual GCC linker files the code in the flash is [g_pfnVectors, _etext), functions placed in the RAM need a range of their own.
+ * return - true: set, false: more than HARDFAULT_MAX_CODE_RANGES ranges
  */
-bool hardFault_readSavedData(void* buffer, uint32_t bufferSize)
+bool hardFault_setCodeRanges(const hardFault_codeRange_t* ranges, uint32_t count)
 {
-	memory_read(ERROR_HANDELING_MEMORY_ADDRESS, buffer, bufferSize);
+	if (count > HARDFAULT_MAX_CODE_RANGES)
+		return false;
+
+	hardFault_codeRange_t sorted[HARDFAULT_MAX_CODE_RANGES];
+	uint32_t sortedCount = 0;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		if (ranges[i].start >= ranges[i].end)
+			continue;
+		uint32_t j = sortedCount++;
+		for (; j > 0 && sorted[j - 1].start > ranges[i].start; j--)
+			sorted[j] = sorted[j - 1];
+		sorted[j] = ranges[i];
+	}
 
-	core_dump_t* core_dump_ptr = buffer;
-	return core_dump_ptr->core_registers.PC != 0xFFFFFFFF;
+	codeRangeCount = 0;
+	for (uint32_t i = 0; i < sortedCount; i++)
+	{
+		if (codeRangeCount > 0 && sorted[i].start <= codeRanges[codeRangeCount - 1].end)
+		{
+			if (sorted[i].end > codeRanges[codeRangeCount - 1].end)
+				codeRanges[codeRangeCount - 1].end = sorted[i].end;
+		}
+		else
+		{
+			codeRanges[codeRangeCount++] = sorted[i];
+		}
+	}
+	return true;
+}
+
+/**
+ * binary search of the code ranges
+ * return - the range holding address, NULL if it isn't code
+ */
+static const hardFault_codeRange_t* prvFindCodeRange(uint32_t address)
+{
+	uint32_t low = 0;
+	uint32_t high = codeRangeCount;
+	while (low < high)
+	{
+		uint32_t middle = low + (high - low) / 2;
+		if (address < codeRanges[middle].start)
+			high = middle;
+		else if (address >= codeRanges[middle].end)
+			low = middle + 1;
+		else
+			return &codeRanges[middle];
+	}
+	return NULL;
 }
 
+#define CODE_HALFWORD(address) (*(const volatile uint16_t*)(uintptr_t)(address))
 
 /**
- * erase the saved hardfault data
+ * return - true if value may be a return address: a Thumb address in the code, following a BL, BLX immediate or BLX register
  */
-void hardFault_eraseSavedData(void)
+static bool prvIsReturnAddress(uint32_t value)
 {
-	memory_erase(ERROR_HANDELING_MEMORY_ADDRESS, ERROR_HANDELING_MEMORY_SIZE);
+	if ((value & 1) == 0)
+		return false;
+	uint32_t address = value & ~1u;
+	const hardFault_codeRange_t* range = prvFindCodeRange(address - 2);
+	if (range == NULL)
+		return false;
+
+	uint16_t previous = CODE_HALFWORD(address - 2);
+	if ((previous & 0xFF87) == 0x4780) // BLX Rm
+		return true;
+	if (address - 4 < range->start)
+		return false;
+	uint16_t first = CODE_HALFWORD(address - 4);
+	return (first & 0xF800) == 0xF000 && (previous & 0xC000) == 0xC000; // BL or BLX immediate
 }
+#endif
 
-// --------------------------------------------------------------------------------------
+#if HARDFAULT_STACK_TRUNCATION == HARDFAULT_TRUNCATE_COMPACT
+#define COMPACT_BUFFER_WORDS 16
+
+/**
+ * write the stack in the format of DUMP_FLAG_STACK_COMPACT, the return addresses are saved without the Thumb bit
+ * the slot must have room for the uint32_t length at least
+ */
+static void prvDumpWriteStackCompact(dump_writer_t* writer, const uint32_t* stack, uint32_t words)
+{
+	/* the raw part takes the space that isn't kept for the return addresses, its length is written first so it must fit */
+	uint32_t rawSpace = writer->end - writer->address - sizeof(uint32_t);
+	rawSpace = rawSpace > HARDFAULT_COMPACT_ADDRESS_BYTES ? rawSpace - HARDFAULT_COMPACT_ADDRESS_BYTES : 0;
+	uint32_t rawWords = MIN(words, rawSpace / sizeof(uint32_t));
+	uint32_t rawLength = rawWords * sizeof(uint32_t);
+	prvDumpWrite(writer, &rawLength, sizeof(rawLength));
+	prvDumpWrite(writer, stack, rawLength);
+
+	uint32_t buffer[COMPACT_BUFFER_WORDS]; // the addresses are buffered to write in bursts
+	uint32_t buffered = 0;
+	uint32_t scanEnd = rawWords + MIN(words - rawWords, HARDFAULT_SCAN_MAX_WORDS);
+	for (uint32_t i = rawWords; i < scanEnd && writer->address < writer->end; i++)
+	{
+		if (!prvIsReturnAddress(stack[i]))
+			continue;
+		buffer[buffered++] = stack[i] & ~1u;
+		if (buffered == COMPACT_BUFFER_WORDS)
+		{
+			prvDumpWrite(writer, buffer, sizeof(buffer));
+			buffered = 0;
+		}
+	}
+	prvDumpWrite(writer, buffer, buffered * sizeof(uint32_t));
+}
+#endif
+
+#if HARDFAULT_STACK_TRUNCATION == HARDFAULT_TRUNCATE_SPLIT
+/**
+ * write a part of the stack with its original address, in the format of DUMP_FLAG_STACK_SPLIT
+ */
+static void prvDumpWriteStackWindow(dump_writer_t* writer, uint32_t address, uint32_t length)
+{
+	stack_window_t window = { .address = address, .length = length };
+	prvDumpWrite(writer, &window, sizeof(window));
+	prvDumpWrite(writer, (const void*)(uintptr_t)address, length);
+}
+#endif
+
+#if HARDFAULT_CAPTURE_BOTH_STACKS || HARDFAULT_CAPTURE_REGIONS
+/**
+ * write memory sections in the format of DUMP_FLAG_SECTIONS
+ * the table is written first, so the sections are cut to the space left in the slot in advance
+ */
+static void prvDumpWriteSectionTable(dump_writer_t* writer, dump_section_t* sections, uint32_t count)
+{
+	uint32_t tableLength = sizeof(count) + count * sizeof(dump_section_t);
+	uint32_t space = writer->end - writer->address;
+	space = space > tableLength ? space - tableLength : 0;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		sections[i].length = MIN(sections[i].length, space);
+		space -= sections[i].length;
+	}
+
+	prvDumpWrite(writer, &count, sizeof(count));
+	prvDumpWrite(writer, sections, count * sizeof(dump_section_t));
+	for (uint32_t i = 0; i < count; i++)
+		prvDumpWrite(writer, (const void*)(uintptr_t)sections[i].address, sections[i].length);
+}
+#endif
+
+#if HARDFAULT_CAPTURE_REGIONS
+/**
+ * write the registered regions as planned by prvPlanRegions
+ */
+static void prvDumpWriteRegions(dump_writer_t* writer)
+{
+	dump_section_t sections[HARDFAULT_MAX_REGIONS];
+	uint32_t count = regionPlanCount;
+	prvFaultSafeCopy(sections, regionPlan, count * sizeof(dump_section_t));
+	prvDumpWriteSectionTable(writer, sections, count);
+}
+#endif
+
+#if HARDFAULT_CAPTURE_BOTH_STACKS
+/**
+ * write the main and process stacks in the format of DUMP_FLAG_SECTIONS
+ * stack - the stack of the violating context after its exception frame
+ */
+static uint32_t prvDumpWriteSections(dump_writer_t* writer, uint32_t stack, uint32_t excReturn)
+{
+	bool processActive = (excReturn & EXC_RETURN_PROCESS_STACK) != 0;
+	dump_section_t sections[2];
+	uint32_t count = 0;
+
+	uint32_t mainBase = getMainStackBase();
+	uint32_t mainStart = stack;
+	if (processActive)
+		mainStart = mainBase - MIN(HARDFAULT_MSP_SECTION_BUDGET, mainBase - HARDFAULT_RAM_START);
+	sections[count++] = (dump_section_t){
+		.tag = DUMP_SECTION_MSP | (processActive ? 0 : DUMP_SECTION_ACTIVE),
+		.address = mainStart,
+		.length = MIN(mainBase - mainStart, HARDFAULT_MSP_SECTION_BUDGET),
+	};
+
+	uint32_t psp = processActive ? stack : __get_PSP();
+	if ((psp & 3) == 0 && psp >= HARDFAULT_RAM_START && psp < PROG_RAM_END)
+	{
+		sections[count++] = (dump_section_t){
+			.tag = DUMP_SECTION_PSP | (processActive ? DUMP_SECTION_ACTIVE : 0),
+			.address = psp,
+			.length = MIN(MIN(getTaskStackBase(psp), PROG_RAM_END) - psp, HARDFAULT_PSP_SECTION_BUDGET),
+		};
+	}
+
+	prvDumpWriteSectionTable(writer, sections, count);
+	return DUMP_FLAG_SECTIONS;
+}
+#endif
+
+#if !HARDFAULT_STACK_RLE && !HARDFAULT_STACK_DMA && !HARDFAULT_CAPTURE_BOTH_STACKS
+/**
+ * write the context stack, following HARDFAULT_STACK_TRUNCATION when it doesn't fit in the slot
+ * return - the DUMP_FLAG_xxx of the format used
+ */
+static uint32_t prvDumpWriteStack(dump_writer_t* writer, const uint32_t* stack, uint32_t length)
+{
+	uint32_t space = writer->end - writer->address;
+#if HARDFAULT_STACK_TRUNCATION == HARDFAULT_TRUNCATE_COMPACT
+	if (length > space && space >= sizeof(uint32_t))
+	{
+		prvDumpWriteStackCompact(writer, stack, length / sizeof(uint32_t));
+		return DUMP_FLAG_STACK_COMPACT;
+	}
+#elif HARDFAULT_STACK_TRUNCATION == HARDFAULT_TRUNCATE_SPLIT
+	if (length > space && space >= 2 * sizeof(stack_window_t))
+	{
+		uint32_t windows = (space - 2 * sizeof(stack_window_t)) & ~3u;
+		uint32_t tailLength = MIN(HARDFAULT_SPLIT_TAIL_BYTES, windows / 2) & ~3u;
+		uint32_t start = (uint32_t)(uintptr_t)stack;
+		prvDumpWriteStackWindow(writer, start, windows - tailLength);
+		prvDumpWriteStackWindow(writer, start + length - tailLength, tailLength);
+		return DUMP_FLAG_STACK_SPLIT;
+	}
+#endif
+	(void)space;
+	prvDumpWrite(writer, stack, length);
+	return 0;
+}
+#endif
+
+#if HARDFAULT_BACKTRACE == HARDFAULT_BACKTRACE_EHABI
+#ifdef HARDFAULT_HOST_SIM
+#define EXIDX_START hostSim_exidxStart
+#define EXIDX_END   hostSim_exidxEnd
+#else
+extern const uint32_t __exidx_start[]; // defined by the linker file around .ARM.exidx
+extern const uint32_t __exidx_end[];
+#define EXIDX_START ((uint32_t)__exidx_start)
+#define EXIDX_END   ((uint32_t)__exidx_end)
+#endif
+
+#define UNWIND_WORD(address) (*(const volatile uint32_t*)(uintptr_t)(address))
+#define EXIDX_CANTUNWIND 0x1
+#define UNWIND_FINISH    0xB0
+
+/**
+ * the virtual registers of the frame being unwound
+ * the stack is read only inside [stackLow, stackHigh), the stack of the violating context from the fault sp to its base.
+ * When the dump is truncated this goes beyond the saved part, so the backtrace can still reach the outer frames
+ */
+typedef struct unwind_state_t {
+	uint32_t r[16];
+	uint32_t stackLow;
+	uint32_t stackHigh;
+}unwind_state_t;
+
+/**
+ * the unwind instructions of a function, a stream of bytes packed most significant first in the words of the tables
+ */
+typedef struct unwind_opcodes_t {
+	uint32_t address;   // the word holding the next opcode
+	uint32_t shift;     // position of the next opcode in the word
+	uint32_t remaining;
+}unwind_opcodes_t;
+
+/**
+ * resolve the place relative 31bit offset stored at address
+ */
+static inline uint32_t prvPrel31(uint32_t address)
+{
+	uint32_t offset = UNWIND_WORD(address) & 0x7FFFFFFF;
+	if (offset & 0x40000000)
+		offset |= 0x80000000;
+	return address + offset;
+}
+
+/**
+ * binary search of .ARM.exidx, which is sorted by function address
+ * return - the address of the entry of the function holding pc, 0 if there isn't one
+ */
+static uint32_t prvExidxFind(uint32_t pc)
+{
+	uint32_t low = 0;
+	uint32_t high = (EXIDX_END - EXIDX_START) / 8;
+	uint32_t entry = 0;
+	while (low < high)
+	{
+		uint32_t middle = low + (high - low) / 2;
+		uint32_t address = EXIDX_START + middle * 8;
+		if (prvPrel31(address) <= pc)
+		{
+			entry = address;
+			low = middle + 1;
+		}
+		else
+		{
+			high = middle;
+		}
+	}
+	return entry;
+}
+
+static inline uint8_t prvUnwindNextOpcode(unwind_opcodes_t* opcodes)
+{
+	if (opcodes->remaining == 0)
+		return UNWIND_FINISH;
+	opcodes->remaining--;
+	uint8_t opcode = (UNWIND_WORD(opcodes->address) >> opcodes->shift) & 0xFF;
+	if (opcodes->shift == 0)
+	{
+		opcodes->shift = 24;
+		opcodes->address += 4;
+	}
+	else
+	{
+		opcodes->shift -= 8;
+	}
+	return opcode;
+}
+
+/**
+ * pop the registers of mask (bit n for rn) in ascending order, as a POP/LDMIA of vsp would
+ * return - false if the registers aren't inside the stack
+ */
+static bool prvUnwindPop(unwind_state_t* state, uint32_t mask)
+{
+	uint32_t vsp = state->r[13];
+	uint32_t count = __builtin_popcount(mask);
+	if ((vsp & 3) || vsp < state->stackLow || vsp > state->stackHigh || (state->stackHigh - vsp) / 4 < count)
+		return false;
+
+	for (uint32_t n = 0; n < 16; n++)
+	{
+		if (mask & (1 << n))
+		{
+			state->r[n] = UNWIND_WORD(vsp);
+			vsp += 4;
+		}
+	}
+	/* popping r13 replaces vsp */
+	if ((mask & (1 << 13)) == 0)
+		state->r[13] = vsp;
+	return true;
+}
+
+/**
+ * unwind one frame: restore the registers of the caller of the function holding pc
+ * return - false if the function can't be unwound
+ */
+static bool prvUnwindFrame(unwind_state_t* state, uint32_t pc)
+{
+	uint32_t entry = prvExidxFind(pc);
+	if (entry == 0)
+		return false;
+
+	uint32_t table = entry + 4; // the compact model is either inline in the entry or in .ARM.extab
+	uint32_t data = UNWIND_WORD(table);
+	if (data == EXIDX_CANTUNWIND)
+		return false;
+	if ((data & 0x80000000) == 0)
+	{
+		table = prvPrel31(table);
+		data = UNWIND_WORD(table);
+	}
+
+	unwind_opcodes_t opcodes = { .address = table, .shift = 16, .remaining = 3 };
+	if ((data & 0xF0000000) == 0x80000000)
+	{
+		uint32_t personality = (data >> 24) & 0x0F;
+		if (personality == 1 || personality == 2)
+		{
+			/* long format: a count of additional words, then the opcodes */
+			opcodes.shift = 8;
+			opcodes.remaining = 2 + 4 * ((data >> 16) & 0xFF);
+		}
+		else if (personality != 0)
+		{
+			return false;
+		}
+	}
+	else if ((data & 0x80000000) == 0)
+	{
+		/* a generic personality routine (C++), GCC follows it with a count of additional words and the opcodes */
+		opcodes.address = table + 4;
+		opcodes.remaining = 3 + 4 * (UNWIND_WORD(table + 4) >> 24);
+	}
+	else
+	{
+		return false;
+	}
+
+	bool pcRestored = false;
+	uint32_t executed = 0;
+	for (;;)
+	{
+		if (executed++ == HARDFAULT_UNWIND_MAX_OPCODES)
+			return false;
+
+		uint8_t opcode = prvUnwindNextOpcode(&opcodes);
+		bool popped = true;
+		if ((opcode & 0xC0) == 0x00)      // vsp = vsp + (xxxxxx << 2) + 4
+		{
+			state->r[13] += ((opcode & 0x3F) << 2) + 4;
+		}
+		else if ((opcode & 0xC0) == 0x40) // vsp = vsp - (xxxxxx << 2) - 4
+		{
+			state->r[13] -= ((opcode & 0x3F) << 2) + 4;
+		}
+		else if ((opcode & 0xF0) == 0x80) // pop r4-r15 under mask
+		{
+			uint32_t mask = ((opcode & 0x0F) << 8) | prvUnwindNextOpcode(&opcodes);
+			if (mask == 0)
+				return false;
+			popped = prvUnwindPop(state, mask << 4);
+			pcRestored |= (mask & (1 << 11)) != 0;
+		}
+		else if ((opcode & 0xF0) == 0x90) // vsp = rn
+		{
+			uint32_t n = opcode & 0x0F;
+			if (n == 13 || n == 15)
+				return false;
+			state->r[13] = state->r[n];
+		}
+		else if ((opcode & 0xF0) == 0xA0) // pop r4-r[4+nnn], and r14 when bit 3 is set
+		{
+			uint32_t mask = ((1 << ((opcode & 0x07) + 1)) - 1) << 4;
+			if (opcode & 0x08)
+				mask |= 1 << 14;
+			popped = prvUnwindPop(state, mask);
+		}
+		else if (opcode == UNWIND_FINISH)
+		{
+			break;
+		}
+		else if (opcode == 0xB1)          // pop r0-r3 under mask
+		{
+			uint32_t mask = prvUnwindNextOpcode(&opcodes);
+			if (mask == 0 || (mask & 0xF0))
+				return false;
+			popped = prvUnwindPop(state, mask);
+		}
+		else if (opcode == 0xB2)          // vsp = vsp + 0x204 + (uleb128 << 2)
+		{
+			uint32_t value = 0;
+			uint32_t shift = 0;
+			uint8_t byte;
+			do
+			{
+				byte = prvUnwindNextOpcode(&opcodes);
+				value |= (uint32_t)(byte & 0x7F) << shift;
+				shift += 7;
+			} while ((byte & 0x80) && shift < 28);
+			state->r[13] += 0x204 + (value << 2);
+		}
+		else if (opcode == 0xB3)          // pop VFP d[ssss]-d[ssss+cccc] saved by FSTMFDX
+		{
+			state->r[13] += 8 * ((prvUnwindNextOpcode(&opcodes) & 0x0F) + 1) + 4;
+		}
+		else if ((opcode & 0xF8) == 0xB8) // pop VFP d8-d[8+nnn] saved by FSTMFDX
+		{
+			state->r[13] += 8 * ((opcode & 0x07) + 1) + 4;
+		}
+		else if (opcode == 0xC8 || opcode == 0xC9) // pop VFP d[ssss]-d[ssss+cccc] saved by VPUSH
+		{
+			state->r[13] += 8 * ((prvUnwindNextOpcode(&opcodes) & 0x0F) + 1);
+		}
+		else if ((opcode & 0xF8) == 0xD0) // pop VFP d8-d[8+nnn] saved by VPUSH
+		{
+			state->r[13] += 8 * ((opcode & 0x07) + 1);
+		}
+		else                              // iWMMX, spare and reserved opcodes
+		{
+			return false;
+		}
+
+		if (!popped)
+			return false;
+	}
+
+	if (!pcRestored)
+		state->r[15] = state->r[14];
+	return true;
+}
 
 /**
- * called by the HardFault_Handler
- * stores the core dump and stack to the memory in the format of core_dump_t and reboot the system
+ * unwind the violating context from its registers at the fault and save the backtrace
+ * stackBase - the end of the stack of the violating context
  */
-static void prvGetRegistersFromStack(uint32_t *pulFaultStackAddress)
+static void prvDumpWriteBacktrace(dump_writer_t* writer, const uint32_t* pulFaultStackAddress, const uint32_t* pulCalleeRegisters,
+                                  uint32_t excReturn, uint32_t stackBase)
 {
-	core_registers_t* core_registers = (core_registers_t*)pulFaultStackAddress;
-	uint32_t memoryWriteAddress = ERROR_HANDELING_MEMORY_ADDRESS;
-	hardFault_eraseSavedData();
+	unwind_state_t state;
+	prvFaultSafeCopy(&state.r[0], &pulFaultStackAddress[0], 4 * sizeof(uint32_t));
+	prvFaultSafeCopy(&state.r[4], pulCalleeRegisters, 8 * sizeof(uint32_t));
+	state.r[12] = pulFaultStackAddress[4];
+	state.r[13] = prvFrameEnd(pulFaultStackAddress, excReturn);
+	state.r[14] = pulFaultStackAddress[5];
+	state.r[15] = pulFaultStackAddress[6];
+	state.stackLow = (uint32_t)(uintptr_t)pulFaultStackAddress;
+	state.stackHigh = stackBase;
+
+	uint32_t backtrace[1 + HARDFAULT_BACKTRACE_DEPTH]; // in the format of backtrace_t
+	uint32_t depth = 0;
+	uint32_t pc = state.r[15];
+	while (depth < HARDFAULT_BACKTRACE_DEPTH)
+	{
+		backtrace[1 + depth++] = pc & ~1u;
+		uint32_t sp = state.r[13];
+		/* a return address follows the call, which may be the last instruction of its function */
+		if (!prvUnwindFrame(&state, depth == 1 ? pc : (pc & ~1u) - 1))
+			break;
+
+		/* stop at an exception return, at the end of the chain and when the unwinding doesn't progress */
+		uint32_t callerPc = state.r[15];
+		if (callerPc == 0 || callerPc >= 0xF0000000 || state.r[13] < sp ||
+		    (state.r[13] == sp && (callerPc & ~1u) == (pc & ~1u)))
+			break;
+		pc = callerPc;
+	}
+
+	backtrace[0] = depth;
+	prvDumpWrite(writer, backtrace, (1 + depth) * sizeof(uint32_t));
+}
+#elif HARDFAULT_BACKTRACE == HARDFAULT_BACKTRACE_SCAN
+/**
+ * scan the stack of the violating context for return addresses and save the backtrace
+ * stackBase - the end of the stack of the violating context
+ */
+static void prvDumpWriteBacktrace(dump_writer_t* writer, const uint32_t* pulFaultStackAddress, const uint32_t* pulCalleeRegisters,
+                                  uint32_t excReturn, uint32_t stackBase)
+{
+	(void)pulCalleeRegisters;
+	uint32_t backtrace[1 + HARDFAULT_BACKTRACE_DEPTH]; // in the format of backtrace_t
+	uint32_t depth = 0;
+	backtrace[1 + depth++] = pulFaultStackAddress[6] & ~1u;
+	/* a leaf function may not have pushed its return address yet */
+	if (prvIsReturnAddress(pulFaultStackAddress[5]))
+		backtrace[1 + depth++] = pulFaultStackAddress[5] & ~1u;
+
+	uint32_t frameEnd = prvFrameEnd(pulFaultStackAddress, excReturn);
+	const uint32_t* stack = (const uint32_t*)(uintptr_t)frameEnd;
+	uint32_t words = frameEnd < stackBase ? MIN((stackBase - frameEnd) / sizeof(uint32_t), HARDFAULT_SCAN_MAX_WORDS) : 0;
+	for (uint32_t i = 0; i < words && depth < HARDFAULT_BACKTRACE_DEPTH; i++)
+	{
+		if (prvIsReturnAddress(stack[i]))
+			backtrace[1 + depth++] = stack[i] & ~1u;
+	}
+
+	backtrace[0] = depth;
+	prvDumpWrite(writer, backtrace, (1 + depth) * sizeof(uint32_t));
+}
+#endif
+
+/**
+ * save the core registers and the stack of the crash, truncated to the space left in the slot
+ * return - the DUMP_FLAG_xxx of the saved parts
+ */
+static uint32_t prvDumpWriteContext(dump_writer_t* writer, uint32_t *pulFaultStackAddress, const uint32_t *pulCalleeRegisters,
+                                    uint32_t excReturn, phase_timer_t* timer)
+{
+	(void)pulCalleeRegisters;
+	uint32_t stackBase = getStackBase((uint32_t)(uintptr_t)pulFaultStackAddress, excReturn);
+	uint32_t stackSize = stackBase - (uint32_t)(uintptr_t)pulFaultStackAddress;
+	uint32_t flags = 0;
+	prvDumpWrite(writer, (void*)pulFaultStackAddress, sizeof(core_registers_t));
+#if HARDFAULT_CAPTURE_FPU
+	if ((excReturn & EXC_RETURN_STANDARD_FRAME) == 0)
+		flags |= prvDumpWriteFpu(writer, pulFaultStackAddress);
+#endif
+#if HARDFAULT_BACKTRACE != HARDFAULT_BACKTRACE_NONE
+	prvDumpWriteBacktrace(writer, pulFaultStackAddress, pulCalleeRegisters, excReturn, stackBase);
+	flags |= DUMP_FLAG_BACKTRACE;
+#endif
+#if HARDFAULT_CAPTURE_REGIONS
+	prvDumpWriteRegions(writer);
+	flags |= DUMP_FLAG_REGIONS;
+#endif
+	prvPhaseTimerEnd(timer, DUMP_PHASE_REGISTERS);
+
+#if HARDFAULT_CAPTURE_BOTH_STACKS
+	(void)stackSize;
+	flags |= prvDumpWriteSections(writer, (uint32_t)(uintptr_t)pulFaultStackAddress + sizeof(core_registers_t), excReturn);
+#elif HARDFAULT_STACK_RLE
+	prvDumpWriteStackRle(writer, pulFaultStackAddress + sizeof(core_registers_t) / sizeof(uint32_t), (stackSize - sizeof(core_registers_t)) / sizeof(uint32_t));
+	flags |= DUMP_FLAG_STACK_RLE;
+#elif HARDFAULT_STACK_DMA
+	dma_stack_copy_t dmaCopy;
+	prvDumpWriteStackDma(writer, (uint8_t*)pulFaultStackAddress + sizeof(core_registers_t), stackSize - sizeof(core_registers_t), &dmaCopy);
+#else
+	flags |= prvDumpWriteStack(writer, pulFaultStackAddress + sizeof(core_registers_t) / sizeof(uint32_t), stackSize - sizeof(core_registers_t));
+#endif
+	prvPhaseTimerEnd(timer, DUMP_PHASE_STACK);
+
+#if HARDFAULT_STACK_DMA
+	prvDumpWaitStackDma(&dmaCopy);
+#endif
+	return flags;
+}
+
+/**
+ * the hardware failed to push the exception frame, usually on a stack overflow, so the sp may point outside the memory.
+ * Save only the sp, reading the frame or the stack could fault again and lock the core up without a dump.
+ * return - the DUMP_FLAG_xxx of the saved parts
+ */
+static uint32_t prvDumpWriteStackingError(dump_writer_t* writer, const uint32_t *pulFaultStackAddress, phase_timer_t* timer)
+{
+	core_registers_t core_registers;
+	prvFaultSafeFill(&core_registers, 0, sizeof(core_registers));
+	prvDumpWrite(writer, &core_registers, sizeof(core_registers));
+	uint32_t sp = (uint32_t)(uintptr_t)pulFaultStackAddress;
+	prvDumpWrite(writer, &sp, sizeof(sp));
+	prvPhaseTimerEnd(timer, DUMP_PHASE_REGISTERS);
+	prvPhaseTimerEnd(timer, DUMP_PHASE_STACK);
+	return DUMP_FLAG_STACKING_ERROR;
+}
+
+/**
+ * called by the HardFault_Handler, only referenced from its asm so it's marked used to keep the compiler from dropping it
+ * stores the core dump and stack to the next slot in the format of core_dump_t and reboot the system
+ * pulCalleeRegisters - R4-R11 as pushed by the HardFault_Handler
+ * excReturn - the LR of the exception
+ */
+static void __attribute__((used)) prvGetRegistersFromStack(uint32_t *pulFaultStackAddress, const uint32_t *pulCalleeRegisters, uint32_t excReturn)
+{
+	uint32_t sequence = hardFault_nextSequence;
+	uint32_t slotAddress = prvSlotAddress(sequence);
+	dump_writer_t writer = {
+		.address = slotAddress + HARDFAULT_SLOT_HEADER_SIZE,
+		.end = slotAddress + HARDFAULT_SLOT_SIZE,
+		.erasedEnd = slotAddress,
+		.crc = 0,
+	};
+	phase_timer_t timer;
+	prvFaultSafeFill(&timer, 0, sizeof(timer));
+	prvPhaseTimerStart(&timer);
+#if HARDFAULT_ERASE_MODE == HARDFAULT_ERASE_FULL
+	memory_erase(slotAddress, HARDFAULT_SLOT_SIZE);
+#elif HARDFAULT_ERASE_MODE == HARDFAULT_ERASE_NONE
+	/* the old header stays invalid until the new dump is complete */
+	memory_erase(slotAddress, HARDFAULT_SLOT_HEADER_SIZE);
+#endif
+	prvPhaseTimerEnd(&timer, DUMP_PHASE_ERASE);
 
 	/* save the SCB registers */
 	SCB_registers_t* SCB_registers = (SCB_registers_t*)&(SCB->CFSR);
-	memory_write(memoryWriteAddress, (void*)SCB_registers, sizeof(SCB_registers_t));
-	memoryWriteAddress += sizeof(SCB_registers_t);
-
-	/* save the core registers and the stack of the crash */
-	uint32_t stackBase = getStackBase((uint32_t)pulFaultStackAddress);
-	uint32_t stackSize = stackBase - (uint32_t)pulFaultStackAddress;
-	uint32_t sizeLeftForStackDump = ERROR_HANDELING_MEMORY_ADDRESS + ERROR_HANDELING_MEMORY_SIZE - memoryWriteAddress;
-	uint32_t NumOfbyteToWrite = MIN(stackSize, sizeLeftForStackDump);
-	memory_write(memoryWriteAddress, (void*)pulFaultStackAddress, NumOfbyteToWrite);
+	prvDumpWrite(&writer, (void*)SCB_registers, sizeof(SCB_registers_t));
+
+	/* save the registers that aren't on the stack */
+	extended_registers_t extended_registers;
+	prvFaultSafeCopy(&extended_registers, pulCalleeRegisters, 8 * sizeof(uint32_t));
+	extended_registers.EXC_RETURN = excReturn;
+	prvDumpWrite(&writer, &extended_registers, sizeof(extended_registers));
+
+	uint32_t flags;
+	if (SCB_registers->CFSR & (CFSR_MSTKERR | CFSR_STKERR))
+		flags = prvDumpWriteStackingError(&writer, pulFaultStackAddress, &timer);
+	else
+		flags = prvDumpWriteContext(&writer, pulFaultStackAddress, pulCalleeRegisters, excReturn, &timer);
+
+	/* the dump must be complete before the header validates it */
+	memory_flush();
+	prvPhaseTimerEnd(&timer, DUMP_PHASE_FINALISE);
+#if HARDFAULT_PHASE_TIMING
+	flags |= DUMP_FLAG_PHASE_TIMING;
+#endif
+
+	/* validate the slot */
+	dump_header_t header; // every field is stored, an initialiser would zero fill it with a memset first
+	header.magic = DUMP_MAGIC;
+	header.version = DUMP_FORMAT_VERSION;
+	header.headerSize = sizeof(dump_header_t);
+	header.sequence = sequence;
+	header.length = writer.address - (slotAddress + HARDFAULT_SLOT_HEADER_SIZE);
+	header.flags = flags;
+	header.faultSource = __get_IPSR() & 0x1FF;
+	prvFaultSafeCopy(header.phaseCycles, timer.cycles, sizeof(header.phaseCycles));
+	header.dataCrc = writer.crc;
+	header.headerCrc = prvCrc32(0, &header, offsetof(dump_header_t, headerCrc));
+	memory_write(slotAddress, &header, sizeof(header));
+	memory_flush();
+	hardFault_nextSequence = sequence + 1;
 	
-#ifdef DEBUG
+#if defined(DEBUG) && !defined(HARDFAULT_HOST_SIM)
 	__ASM volatile("BKPT #01"); //force a breakpoint
 	for (;;) ;
 #endif
 	NVIC_SystemReset();
 }
 
+#ifndef HARDFAULT_HOST_SIM
+#define STRINGIFY_(x) #x
+#define STRINGIFY(x) STRINGIFY_(x)
+
+#if HARDFAULT_FAULT_STACK_SIZE
+static uint64_t prvFaultStack[HARDFAULT_FAULT_STACK_SIZE / sizeof(uint64_t)] __attribute__((used));
+#define SWITCH_TO_FAULT_STACK \
+	    " ldr r3, fault_stack_address_const                         \n" /* move to the fault stack, the violating stack may be exhausted */ \
+	    " mov sp, r3                                                \n"
+#define FAULT_STACK_ADDRESS_CONST \
+	    " fault_stack_address_const: .word prvFaultStack + " STRINGIFY(HARDFAULT_FAULT_STACK_SIZE) " \n"
+#else
+#define SWITCH_TO_FAULT_STACK
+#define FAULT_STACK_ADDRESS_CONST
+#endif
+
+static volatile uint32_t prvCaptureActive __attribute__((used)); // set by the first handler to run, cleared by the reset
+
 /**
  * Hard Fault Handling Code (Taken from FreeRTOS)
- * The fault handler implementation calls a function prvGetRegistersFromStack(uint32_t *pulFaultStackAddress). 
+ * The fault handler implementation calls a function prvGetRegistersFromStack(uint32_t *pulFaultStackAddress, const uint32_t *pulCalleeRegisters, uint32_t excReturn).
  * pulFaultStackAddress will contain values of 8 core registers: r0, r1, r2, r3, r12, lr, pc, psr
+ * pulCalleeRegisters will contain r4-r11, pushed to the fault stack (or the main stack) since the hardware doesn't stack them
+ * excReturn is the value of the lr on entry to the exception
+ * A handler entered while a capture is running resets the system without touching the fault stack, the slot or the storage state.
  */
 __attribute__((naked)) void HardFault_Handler(void)
 {
@@ -155,9 +2444,67 @@ __attribute__((naked)) void HardFault_Handler(void)
 	    " ite eq                                                    \n"
 	    " mrseq r0, msp                                             \n" //if we used the MSP copy it to r0
 	    " mrsne r0, psp                                             \n" //if we used the PSP copy it to r0
-	    " ldr r1, [r0, #24]                                         \n"
-	    " ldr r2, handler2_address_const                            \n"
-	    " bx r2                                                     \n" //jump to prvGetRegistersFromStack(uint32_t *pulFaultStackAddress)
+	    " mov r2, lr                                                \n" //pass the EXC_RETURN in r2
+	    " ldr r3, capture_active_address_const                      \n"
+	    " ldr r1, [r3]                                              \n"
+	    " cbnz r1, nested_capture                                   \n" //a capture is running already, this handler preempted it
+	    " movs r1, #1                                               \n"
+	    " str r1, [r3]                                              \n"
+	    SWITCH_TO_FAULT_STACK                                            //the handler resets the system, the main stack is never returned to
+	    " push {r4-r11}                                             \n" //save the callee saved registers before C code can change them
+	    " mov r1, sp                                                \n" //and pass their address in r1
+	    " ldr r3, handler2_address_const                            \n"
+	    " bx r3                                                     \n" //jump to prvGetRegistersFromStack(pulFaultStackAddress, pulCalleeRegisters, excReturn)
+	    "nested_capture:                                            \n"
+	    " ldr r0, aircr_address_const                               \n"
+	    " ldr r1, aircr_reset_const                                 \n"
+	    " dsb                                                       \n"
+	    " str r1, [r0]                                              \n" //request a system reset, like NVIC_SystemReset
+	    " dsb                                                       \n"
+	    " b .                                                       \n"
+	    " .align 2                                                  \n"
 	    " handler2_address_const: .word prvGetRegistersFromStack    \n"
+	    " capture_active_address_const: .word prvCaptureActive      \n"
+	    " aircr_address_const: .word 0xE000ED0C                     \n" //SCB->AIRCR
+	    " aircr_reset_const: .word 0x05FA0004                       \n" //VECTKEY | SYSRESETREQ
+	    FAULT_STACK_ADDRESS_CONST
 	);
 }
+
+/* the other handlers run the same code, the dump tells them apart by the IPSR */
+#if HARDFAULT_HANDLE_CONFIGURABLE_FAULTS
+void MemManage_Handler(void) __attribute__((alias("HardFault_Handler")));
+void BusFault_Handler(void) __attribute__((alias("HardFault_Handler")));
+void UsageFault_Handler(void) __attribute__((alias("HardFault_Handler")));
+#endif
+#if HARDFAULT_HANDLE_NMI
+void NMI_Handler(void) __attribute__((alias("HardFault_Handler")));
+#endif
+
+#else
+/********************* Host Simulation *******************************/
+
+/**
+ * the copy the capture uses instead of memcpy
+ */
+void hostSim_faultSafeCopy(void* destination, const void* source, uint32_t length)
+{
+	prvFaultSafeCopy(destination, source, length);
+}
+
+/**
+ * the CRC-32 of the dumps, computed by the selected engine
+ */
+uint32_t hostSim_crc32(uint32_t crc, const void* data, uint32_t length)
+{
+	return prvCrc32(crc, data, length);
+}
+
+/**
+ * the HardFault_Handler, once it has pushed R4-R11
+ */
+void hostSim_capture(uint32_t* sp, const uint32_t* calleeRegisters, uint32_t excReturn)
+{
+	prvGetRegistersFromStack(sp, calleeRegisters, excReturn);
+}
+#endif
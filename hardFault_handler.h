@@ -0,0 +1,235 @@
+/**
+ * The public interface of the hardfault handler (hardFault_handler.c)
+ * the format of the saved dumps, and the functions that configure the handler and read the dumps back after the reset.
+ * Functions that depend on a build option exist only in builds with that option, see their description in hardFault_handler.c
+ */
+#ifndef HARDFAULT_HANDLER_H
+#define HARDFAULT_HANDLER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define EXC_RETURN_STANDARD_FRAME (1 << 4) // cleared when the exception frame includes S0-S15 and FPSCR
+#define EXC_RETURN_PROCESS_STACK  (1 << 2) // set when the violating context used the PSP
+
+/********************* Dump Format *******************************/
+
+/**
+ * The SCB registers in the order they are defined in core_cm4.h
+ */
+typedef struct __attribute__((__packed__)) SCB_registers_t {
+	uint32_t CFSR;
+	uint32_t HFSR;
+	uint32_t DFSR;
+	uint32_t MMFAR;
+	uint32_t BFAR;
+	uint32_t AFSR;
+}SCB_registers_t;
+
+#define CFSR_MSTKERR (1 << 4)  // MemManage fault while stacking the exception frame
+#define CFSR_STKERR  (1 << 12) // BusFault while stacking the exception frame
+
+typedef struct __attribute__((__packed__)) core_registers_t {
+	uint32_t R0;
+	uint32_t R1;
+	uint32_t R2;
+	uint32_t R3;
+	uint32_t R12;
+	uint32_t LR;
+	uint32_t PC;
+	uint32_t PSR;
+}core_registers_t;
+
+/**
+ * The registers the hardware doesn't stack, pushed by the HardFault_Handler
+ */
+typedef struct __attribute__((__packed__)) extended_registers_t {
+	uint32_t R4;
+	uint32_t R5;
+	uint32_t R6;
+	uint32_t R7;
+	uint32_t R8;
+	uint32_t R9;
+	uint32_t R10;
+	uint32_t R11;
+	uint32_t EXC_RETURN; // the LR of the exception
+}extended_registers_t;
+
+/**
+ * Cortex-M4F FPU state of the violating context, saved when the context used the FPU
+ * S16-S31 are saved only with HARDFAULT_CAPTURE_FPU_HIGH_REGISTERS (DUMP_FLAG_FPU_HIGH)
+ */
+typedef struct __attribute__((__packed__)) fpu_registers_t {
+	uint32_t S[32];
+	uint32_t FPSCR;
+}fpu_registers_t;
+
+/**
+ * the backtrace of the violating context, innermost first
+ * the first address is the PC of the fault, the others are return addresses (without the Thumb bit)
+ */
+typedef struct __attribute__((__packed__)) backtrace_t {
+	uint32_t depth;
+	uint32_t address[]; // depth entries
+}backtrace_t;
+
+/**
+ * a part of the stack saved with DUMP_FLAG_STACK_SPLIT
+ */
+typedef struct __attribute__((__packed__)) stack_window_t {
+	uint32_t address; // the address of the first byte on the stack
+	uint32_t length;  // the number of bytes following
+}stack_window_t;
+
+#define DUMP_SECTION_MSP    1
+#define DUMP_SECTION_PSP    2
+#define DUMP_SECTION_ACTIVE (1 << 8) // the stack of the violating context, the section starts after its exception frame
+
+/**
+ * a stack saved with DUMP_FLAG_SECTIONS
+ */
+typedef struct __attribute__((__packed__)) dump_section_t {
+	uint32_t tag;     // DUMP_SECTION_xxx, or the tag of a registered region
+	uint32_t address; // the address of the first byte on the stack
+	uint32_t length;
+}dump_section_t;
+
+/**
+ * Each slot starts with a self describing header, written after the rest of the dump.
+ * The header is validated by its magic, version and headerCrc, so finding the saved dumps at boot reads only the headers.
+ * The dump itself is validated by dataCrc, which is computed while the dump is written.
+ * Both are CRC-32 (the zlib/ethernet polynomial).
+ */
+#define DUMP_MAGIC 0x54444648 // "HFDT"
+#define DUMP_FORMAT_VERSION 3
+
+#define DUMP_PHASE_ERASE     0 // preparing the slot
+#define DUMP_PHASE_REGISTERS 1 // saving the SCB, core and FPU registers, the backtrace and the registered regions
+#define DUMP_PHASE_STACK     2 // saving the context stack
+#define DUMP_PHASE_FINALISE  3 // waiting for the storage to complete the dump, before the header is written
+#define DUMP_PHASE_COUNT     4
+
+typedef struct __attribute__((__packed__)) dump_header_t {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t headerSize; // sizeof(dump_header_t)
+	uint32_t sequence;
+	uint32_t length;     // length of the core_dump_t following the header, including the stack
+	uint32_t flags;      // DUMP_FLAG_xxx
+	uint32_t faultSource; // HARDFAULT_SOURCE_xxx, the exception that saved the dump
+	uint32_t phaseCycles[DUMP_PHASE_COUNT]; // DUMP_FLAG_PHASE_TIMING: the cycles spent in each DUMP_PHASE_xxx
+	uint32_t dataCrc;    // CRC of the length bytes following the header
+	uint32_t headerCrc;  // CRC of the header fields before it
+}dump_header_t;
+
+#define DUMP_FLAG_STACK_RLE (1 << 0) // the context stack is encoded, see hardFault_decodeStack
+#define DUMP_FLAG_FPU       (1 << 1) // a fpu_registers_t precedes the context stack
+#define DUMP_FLAG_FPU_HIGH  (1 << 2) // S16-S31 of the fpu_registers_t are valid
+#define DUMP_FLAG_PHASE_TIMING (1 << 3) // the phaseCycles of the header are valid
+#define DUMP_FLAG_BACKTRACE (1 << 4) // a backtrace_t precedes the context stack, after the fpu_registers_t if any
+#define DUMP_FLAG_STACK_COMPACT (1 << 5) // the context stack is a uint32_t length, that many bytes of stack, then return addresses until the end of the dump
+#define DUMP_FLAG_STACK_SPLIT   (1 << 6) // the context stack is two stack_window_t, each followed by its bytes of stack
+#define DUMP_FLAG_STACKING_ERROR (1 << 7) // the exception frame wasn't stacked: the core_registers are zero and the context stack is only the uint32_t sp
+#define DUMP_FLAG_SECTIONS (1 << 8) // the context stack is a uint32_t count, that many dump_section_t, then the bytes of each section in order
+#define DUMP_FLAG_REGIONS  (1 << 9) // the registered regions precede the context stack, after the backtrace_t if any, in the format of DUMP_FLAG_SECTIONS
+
+/**
+ * the exception numbers of the handlers that save a dump
+ */
+#define HARDFAULT_SOURCE_NMI        2
+#define HARDFAULT_SOURCE_HARDFAULT  3
+#define HARDFAULT_SOURCE_MEMMANAGE  4
+#define HARDFAULT_SOURCE_BUSFAULT   5
+#define HARDFAULT_SOURCE_USAGEFAULT 6
+
+/**
+ * the dump will be saved to the memory in the following format, right after the slot header
+ * with DUMP_FLAG_FPU the context_stack starts with a fpu_registers_t, then with DUMP_FLAG_BACKTRACE a backtrace_t,
+ * then with DUMP_FLAG_REGIONS the registered regions
+ */
+typedef struct __attribute__((__packed__)) core_dump_t {
+	SCB_registers_t SCB_registers;
+	extended_registers_t extended_registers;
+	core_registers_t core_registers;
+	uint8_t  context_stack[];
+}core_dump_t;
+
+/********************* Reading The Dumps *******************************/
+
+/**
+ * iterates over the saved dumps, newest first
+ */
+typedef struct hardFault_dumpIterator_t {
+	uint32_t nextSequence; // the sequence number to check next
+	uint32_t remaining;    // the number of slots left to check
+	uint32_t sequence;     // the sequence number of the last dump returned
+	uint32_t length;       // the length of the last dump returned
+	uint32_t flags;        // the DUMP_FLAG_xxx of the last dump returned
+	uint32_t faultSource;  // the HARDFAULT_SOURCE_xxx of the last dump returned
+}hardFault_dumpIterator_t;
+
+/**
+ * reads a saved dump in chunks of any size, so it can be streamed out without a buffer as large as the dump
+ * The CRC of the dump is checked as it is read, hardFault_dumpCursorValid tells the result once everything was read.
+ */
+typedef struct hardFault_dumpCursor_t {
+	uint32_t address;   // storage address of the next byte
+	uint32_t remaining; // bytes left to read
+	uint32_t crc;       // CRC of the bytes read so far
+	uint32_t dataCrc;   // the CRC saved in the header
+}hardFault_dumpCursor_t;
+
+/**
+ * a view of a saved dump in place, for storage the CPU can read directly
+ * The dump is validated once when the view is made, then its fields are read without copying
+ */
+typedef struct hardFault_dumpView_t {
+	const dump_header_t* header;
+	const SCB_registers_t* SCB_registers;
+	const extended_registers_t* extended_registers;
+	const core_registers_t* core_registers;
+	const fpu_registers_t* fpu_registers; // NULL without DUMP_FLAG_FPU
+	const backtrace_t* backtrace;         // NULL without DUMP_FLAG_BACKTRACE
+	const uint8_t* regions;               // the registered regions in the format of DUMP_FLAG_SECTIONS, NULL without DUMP_FLAG_REGIONS
+	uint32_t regionsLength;
+	const uint8_t* context_stack;         // encoded with DUMP_FLAG_STACK_RLE
+	uint32_t contextStackLength;
+}hardFault_dumpView_t;
+
+void hardFault_init(void);
+void hardFault_eraseSavedData(void);
+
+void hardFault_dumpIteratorInit(hardFault_dumpIterator_t* iterator);
+bool hardFault_dumpIteratorNext(hardFault_dumpIterator_t* iterator, void* buffer, uint32_t bufferSize);
+bool hardFault_dumpIteratorNextCursor(hardFault_dumpIterator_t* iterator, hardFault_dumpCursor_t* cursor);
+uint32_t hardFault_dumpCursorRead(hardFault_dumpCursor_t* cursor, void* buffer, uint32_t bufferSize);
+bool hardFault_dumpCursorValid(const hardFault_dumpCursor_t* cursor);
+uint32_t hardFault_decodeStack(const void* encoded, uint32_t encodedLength, void* stack, uint32_t stackSize);
+uint32_t hardFault_sectionTableLength(const uint8_t* table, uint32_t length);
+
+/* HARDFAULT_STORAGE_MEMORY_MAPPED: RAM and INTERNAL_FLASH */
+const void* hardFault_dumpCursorSpan(hardFault_dumpCursor_t* cursor, uint32_t maxLength, uint32_t* length);
+bool hardFault_dumpIteratorNextView(hardFault_dumpIterator_t* iterator, hardFault_dumpView_t* view);
+bool hardFault_dumpViewIsStackingError(const hardFault_dumpView_t* view);
+
+/********************* Configuration *******************************/
+
+/**
+ * an address range holding code, [start, end)
+ */
+typedef struct hardFault_codeRange_t {
+	uint32_t start;
+	uint32_t end;
+}hardFault_codeRange_t;
+
+/* HARDFAULT_TASK_STACK_REGISTERED */
+bool hardFault_registerTaskStack(uint32_t stackStart, uint32_t stackEnd);
+void hardFault_unregisterTaskStack(uint32_t stackStart);
+
+/* HARDFAULT_CAPTURE_REGIONS */
+bool hardFault_registerRegion(const void* address, uint32_t length, uint32_t priority, uint32_t tag);
+
+/* HARDFAULT_BACKTRACE_SCAN, HARDFAULT_TRUNCATE_COMPACT */
+bool hardFault_setCodeRanges(const hardFault_codeRange_t* ranges, uint32_t count);
+
+#endif
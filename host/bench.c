@@ -0,0 +1,464 @@
+/**
+ * Benchmarks of the hardfault handler, on the host simulation
+ * The options compared are compile time, so the Makefile builds this file once per configuration
+ * and each run prints the rows of its configuration.
+ * Host times are the fastest of BENCH_REPEAT captures, cycles are simulated by the device models of hostSim_devices.c.
+ * usage: bench <configuration name> <benchmark>...
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include "hardFault_handler.h"
+#include "hostSim.h"
+
+#define BENCH_REPEAT 20
+
+#define EXC_RETURN_THREAD_MSP 0xFFFFFFF9
+
+#define MAIN_STACK_BASE (PROG_RAM_END)
+
+static const char* config = "";
+
+typedef struct bench_result_t {
+	hostSim_result_t last;  // the last capture
+	uint64_t nanoseconds;   // the fastest capture
+	uint64_t readNanoseconds; // the fastest read back
+	uint32_t bytesErased;   // per capture
+	uint32_t bytesRead;     // per capture, from the storage that isn't memory mapped
+	uint32_t programCount;  // per capture
+	bool valid;             // all the captures were valid
+}bench_result_t;
+
+/**
+ * a main stack fault on the first words of hostSim_stack, filled like a running program
+ */
+static hostSim_fault_t prvFault(uint32_t words)
+{
+	return hostSim_makeFault(words, MAIN_STACK_BASE, EXC_RETURN_THREAD_MSP);
+}
+
+/**
+ * capture the fault BENCH_REPEAT times, the slots are reused so every slot is written more than once
+ */
+static bench_result_t prvCapture(const hostSim_fault_t* fault)
+{
+	bench_result_t bench = {.nanoseconds = UINT64_MAX, .readNanoseconds = UINT64_MAX, .valid = true};
+	uint32_t erased = hostSim_storageStats.bytesErased;
+	uint32_t read = hostSim_storageStats.bytesRead;
+	uint32_t programs = hostSim_storageStats.programCount;
+	for (uint32_t i = 0; i < BENCH_REPEAT; i++)
+	{
+		hostSim_result_t result = {0};
+		bench.valid = hostSim_fault(fault, &result) && result.valid && bench.valid;
+		if (result.nanoseconds < bench.nanoseconds)
+			bench.nanoseconds = result.nanoseconds;
+		if (result.readNanoseconds < bench.readNanoseconds)
+			bench.readNanoseconds = result.readNanoseconds;
+		bench.last = result;
+	}
+	bench.bytesErased = (hostSim_storageStats.bytesErased - erased) / BENCH_REPEAT;
+	bench.bytesRead = (hostSim_storageStats.bytesRead - read) / BENCH_REPEAT;
+	bench.programCount = (hostSim_storageStats.programCount - programs) / BENCH_REPEAT;
+	return bench;
+}
+
+// --------------------------------------------------------------------------------------
+
+/**
+ * capture main stack faults of a few sizes, from a small dump to one close to the slot size
+ * print - prints the row of each size
+ */
+static void prvBenchStackSizes(void (*print)(uint32_t stackBytes, const bench_result_t* bench))
+{
+	static const uint32_t stackBytes[] = {256, 2048, 6144};
+	for (uint32_t i = 0; i < sizeof(stackBytes) / sizeof(stackBytes[0]); i++)
+	{
+		uint32_t words = stackBytes[i] / sizeof(uint32_t);
+		hostSim_fault_t fault = prvFault(words);
+		bench_result_t bench = prvCapture(&fault);
+		print(stackBytes[i], &bench);
+	}
+}
+
+/**
+ * the cost of preparing the slot, HARDFAULT_ERASE_MODE, for small and large dumps
+ */
+static void prvPrintErase(uint32_t stackBytes, const bench_result_t* bench)
+{
+	printf("%-24s %8u %10u %10llu %8u %10u %-5s\n", config, stackBytes, bench->last.cycles,
+	       (unsigned long long)bench->nanoseconds, bench->last.bytesWritten, bench->bytesErased, bench->valid ? "yes" : "no");
+}
+
+static void prvBenchErase(void)
+{
+	printf("%-24s %8s %10s %10s %8s %10s %-5s\n", "config", "stack", "cycles", "ns", "bytes", "erased", "valid");
+	prvBenchStackSizes(prvPrintErase);
+}
+
+/**
+ * capture and read back on each storage backend
+ */
+static void prvPrintBackends(uint32_t stackBytes, const bench_result_t* bench)
+{
+	printf("%-24s %8u %10u %10llu %10llu %8u %10u %-5s\n", config, stackBytes, bench->last.cycles,
+	       (unsigned long long)bench->nanoseconds, (unsigned long long)bench->readNanoseconds,
+	       bench->last.bytesWritten, bench->bytesRead, bench->valid ? "yes" : "no");
+}
+
+static void prvBenchBackends(void)
+{
+	printf("%-24s %8s %10s %10s %10s %8s %10s %-5s\n", "config", "stack", "cycles", "ns", "read ns", "bytes", "read", "valid");
+	prvBenchStackSizes(prvPrintBackends);
+}
+
+/**
+ * the internal flash with the double buffered programming, against a device that programs synchronously
+ * (HOSTSIM_FLASH_SYNC), where the copy to the staging buffer can't overlap the programming
+ */
+static void prvPrintPipeline(uint32_t stackBytes, const bench_result_t* bench)
+{
+	printf("%-24s %8u %10u %8u %10u %-5s\n", config, stackBytes, bench->last.cycles,
+	       bench->last.bytesWritten, bench->programCount, bench->valid ? "yes" : "no");
+}
+
+static void prvBenchPipeline(void)
+{
+	printf("%-24s %8s %10s %8s %10s %-5s\n", "config", "stack", "cycles", "bytes", "programs", "valid");
+	prvBenchStackSizes(prvPrintPipeline);
+}
+
+/**
+ * the stack images of the RLE benchmark: the used top of the stack, then the rest as it was left
+ */
+typedef enum {
+	IMAGE_ZERO,      // the rest was never used, zero initialised
+	IMAGE_WATERMARK, // the rest holds the 0xA5A5A5A5 fill of the RTOS stack watermark
+	IMAGE_RANDOM,    // the entire stack was used
+}stack_image_t;
+
+static void prvFillImage(stack_image_t image, uint32_t words, uint32_t usedWords)
+{
+	uint32_t seed = 0x9E3779B9;
+	for (uint32_t i = 0; i < words; i++)
+	{
+		seed = seed * 1664525 + 1013904223;
+		if (i < usedWords || image == IMAGE_RANDOM)
+			hostSim_stack[i] = seed;
+		else
+			hostSim_stack[i] = (image == IMAGE_ZERO) ? 0 : 0xA5A5A5A5;
+	}
+	hostSim_stack[7] = 0x01000000;
+}
+
+/**
+ * the size of the saved stack against the cost of the capture, HARDFAULT_STACK_RLE
+ */
+static void prvBenchRle(void)
+{
+	static const struct {
+		const char* name;
+		stack_image_t image;
+	} images[] = {
+		{"zero", IMAGE_ZERO},
+		{"watermark", IMAGE_WATERMARK},
+		{"random", IMAGE_RANDOM},
+	};
+	const uint32_t words = 6144 / sizeof(uint32_t);
+	printf("%-24s %-10s %10s %10s %8s %8s %6s %-5s\n", "config", "image", "cycles", "ns", "bytes", "saved", "ratio", "valid");
+	for (uint32_t i = 0; i < sizeof(images) / sizeof(images[0]); i++)
+	{
+		hostSim_fault_t fault = prvFault(words);
+		prvFillImage(images[i].image, words, 128);
+		bench_result_t bench = prvCapture(&fault);
+		/* the context stack as saved, encoded or not, against the stack it holds */
+		printf("%-24s %-10s %10u %10llu %8u %8u %6.2f %-5s\n", config, images[i].name, bench.last.cycles,
+		       (unsigned long long)bench.nanoseconds, bench.last.bytesWritten, bench.last.contextStackLength,
+		       (double)bench.last.stackBytes / bench.last.contextStackLength, bench.valid ? "yes" : "no");
+	}
+}
+
+static uint64_t prvNanoseconds(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000000u + now.tv_nsec;
+}
+
+/**
+ * the byte wise table driven CRC-32, the reference the engines are checked against
+ */
+static uint32_t prvCrc32Reference(uint32_t crc, const void* data, uint32_t length)
+{
+	static uint32_t table[256];
+	if (table[1] == 0)
+	{
+		for (uint32_t i = 0; i < 256; i++)
+		{
+			uint32_t value = i;
+			for (uint32_t bit = 0; bit < 8; bit++)
+				value = (value >> 1) ^ (0xEDB88320 & -(value & 1));
+			table[i] = value;
+		}
+	}
+	const uint8_t* bytes = data;
+	crc = ~crc;
+	while (length--)
+		crc = (crc >> 8) ^ table[(crc ^ *bytes++) & 0xFF];
+	return ~crc;
+}
+
+/**
+ * the CRC engine of the build, HARDFAULT_CRC_ENGINE, against the byte wise reference,
+ * over the fixed part of a dump, a typical stack and a full slot
+ */
+static void prvBenchCrc(void)
+{
+	static const uint32_t sizes[] = {128, 1024, 8192};
+	static const struct {
+		const char* name;
+		uint32_t (*crc32)(uint32_t crc, const void* data, uint32_t length);
+	} engines[] = {
+		{"engine", hostSim_crc32},
+		{"byte wise", prvCrc32Reference},
+	};
+	uint8_t* data = (uint8_t*)hostSim_stack;
+	for (uint32_t i = 0; i < sizeof(hostSim_stack); i++)
+		data[i] = (uint8_t)(i * 131 + (i >> 8));
+
+	printf("%-24s %-10s %8s %10s %10s %8s %-5s\n", "config", "crc", "bytes", "cycles", "ns", "MB/s", "match");
+	for (uint32_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+	{
+		uint32_t reference = prvCrc32Reference(0, data, sizes[i]);
+		for (uint32_t e = 0; e < sizeof(engines) / sizeof(engines[0]); e++)
+		{
+			/* chained over two parts, the way the dump is written */
+			uint32_t startCycles = hostSim_cycles;
+			uint32_t crc = engines[e].crc32(engines[e].crc32(0, data, sizes[i] / 3), data + sizes[i] / 3, sizes[i] - sizes[i] / 3);
+			uint32_t cycles = hostSim_cycles - startCycles;
+			uint64_t best = UINT64_MAX;
+			for (uint32_t repeat = 0; repeat < BENCH_REPEAT; repeat++)
+			{
+				uint64_t start = prvNanoseconds();
+				for (uint32_t call = 0; call < 100; call++)
+					crc ^= engines[e].crc32(crc, data, sizes[i]);
+				uint64_t elapsed = (prvNanoseconds() - start) / 100;
+				if (elapsed < best)
+					best = elapsed;
+			}
+			bool match = engines[e].crc32(engines[e].crc32(0, data, sizes[i] / 3), data + sizes[i] / 3, sizes[i] - sizes[i] / 3) == reference;
+			printf("%-24s %-10s %8u %10u %10llu %8.1f %-5s\n", config, engines[e].name, sizes[i], cycles,
+			       (unsigned long long)best, best ? sizes[i] * 1000.0 / best : 0.0, match ? "yes" : "no");
+		}
+	}
+}
+
+/**
+ * a byte by byte copy, what a size optimised memcpy does
+ */
+static void prvByteCopy(void* destination, const void* source, uint32_t length)
+{
+	uint8_t* dst = destination;
+	const uint8_t* src = source;
+	while (length-- > 0)
+	{
+		*dst++ = *src++;
+		__asm volatile ("" : : : "memory"); // keep it from being turned back into a memcpy call
+	}
+}
+
+static void prvMemcpy(void* destination, const void* source, uint32_t length)
+{
+	memcpy(destination, source, length);
+}
+
+/**
+ * the copy of the capture against memcpy and a byte copy, with aligned and misaligned buffers
+ * This runs the host build of the copy, the C loop that stands for the LDM/STM burst.
+ * The burst itself still needs a target run (e.g. QEMU mps2-an386), which this sandbox can't do.
+ */
+static void prvBenchCopy(void)
+{
+	static uint32_t destination[2048];
+	static const uint32_t sizes[] = {32, 256, 4096};
+	static const uint32_t offsets[] = {0, 1}; // the source offset, a misaligned source can't use the burst
+	static const struct {
+		const char* name;
+		void (*copy)(void* destination, const void* source, uint32_t length);
+	} copies[] = {
+		{"fault safe", hostSim_faultSafeCopy},
+		{"memcpy", prvMemcpy},
+		{"byte", prvByteCopy},
+	};
+	const uint8_t* source = (const uint8_t*)hostSim_stack;
+	prvFault(HOSTSIM_STACK_WORDS);
+
+	printf("%-24s %-10s %8s %6s %10s %8s %-5s\n", "config", "copy", "bytes", "offset", "ns", "MB/s", "match");
+	for (uint32_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+	{
+		for (uint32_t o = 0; o < sizeof(offsets) / sizeof(offsets[0]); o++)
+		{
+			for (uint32_t c = 0; c < sizeof(copies) / sizeof(copies[0]); c++)
+			{
+				uint64_t best = UINT64_MAX;
+				for (uint32_t repeat = 0; repeat < BENCH_REPEAT; repeat++)
+				{
+					uint64_t start = prvNanoseconds();
+					for (uint32_t call = 0; call < 100; call++)
+						copies[c].copy(destination, source + offsets[o], sizes[i]);
+					uint64_t elapsed = (prvNanoseconds() - start) / 100;
+					if (elapsed < best)
+						best = elapsed;
+				}
+				bool match = memcmp(destination, source + offsets[o], sizes[i]) == 0;
+				printf("%-24s %-10s %8u %6u %10llu %8.1f %-5s\n", config, copies[c].name, sizes[i], offsets[o],
+				       (unsigned long long)best, best ? sizes[i] * 1000.0 / best : 0.0, match ? "yes" : "no");
+			}
+		}
+	}
+}
+
+#define SCAN_CODE_START (HOSTSIM_RAM_BASE + 0x10000)
+#define SCAN_CODE_SIZE  0x4000
+#define SCAN_CALLS      12
+
+/**
+ * the stack scanning backtrace, HARDFAULT_BACKTRACE_SCAN: the return addresses it finds and its cost.
+ * The code is random halfwords with BL sites planted in it, the 4KB stack is random data,
+ * pointers into the code that aren't return addresses (function pointers, literals)
+ * and a return address of each planted call.
+ */
+static void prvBenchScan(void)
+{
+	uint16_t* code = (uint16_t*)(uintptr_t)SCAN_CODE_START;
+	uint32_t seed = 0x2545F491;
+	for (uint32_t i = 0; i < SCAN_CODE_SIZE / sizeof(uint16_t); i++)
+	{
+		seed = seed * 1664525 + 1013904223;
+		code[i] = (uint16_t)(seed >> 16);
+	}
+	uint32_t calls[SCAN_CALLS];
+	for (uint32_t i = 0; i < SCAN_CALLS; i++)
+	{
+		uint32_t site = SCAN_CODE_START + 64 + i * (SCAN_CODE_SIZE - 128) / SCAN_CALLS;
+		code[(site - SCAN_CODE_START) / 2] = 0xF000;     // BL, first halfword
+		code[(site - SCAN_CODE_START) / 2 + 1] = 0xF800; // BL, second halfword
+		calls[i] = (site + 4) | 1;
+	}
+
+	const uint32_t words = 4096 / sizeof(uint32_t);
+	hostSim_fault_t fault = prvFault(words);
+	uint32_t codePointers = 0;
+	for (uint32_t i = 0; i < words; i++)
+	{
+		seed = seed * 1664525 + 1013904223;
+		if (i % 8 == 3)
+		{
+			hostSim_stack[i] = (SCAN_CODE_START + (seed >> 8) % SCAN_CODE_SIZE) | 1;
+			codePointers++;
+		}
+		else
+		{
+			hostSim_stack[i] = seed & ~1u; // data: never a Thumb address
+		}
+	}
+	hostSim_stack[5] = 0;                                  // LR of the frame: not a return address
+	hostSim_stack[6] = SCAN_CODE_START + 0x100;            // PC of the fault
+	hostSim_stack[7] = 0x01000000;
+	for (uint32_t i = 0; i < SCAN_CALLS; i++)
+		hostSim_stack[8 + 5 + i * (words - 16) / SCAN_CALLS] = calls[i];
+
+	fault.codeStart = SCAN_CODE_START;
+	fault.codeEnd = SCAN_CODE_START + SCAN_CODE_SIZE;
+	bench_result_t bench = prvCapture(&fault);
+
+	uint32_t found = 0;
+	uint32_t falsePositives = 0;
+	for (uint32_t i = 1; i < bench.last.backtraceDepth; i++)
+	{
+		bool planted = false;
+		for (uint32_t c = 0; c < SCAN_CALLS; c++)
+			planted = planted || bench.last.backtrace[i] == (calls[c] & ~1u);
+		if (planted)
+			found++;
+		else
+			falsePositives++;
+	}
+	printf("%-24s %8s %8s %8s %8s %8s %10s %-5s\n", "config", "stack", "pointers", "planted", "found", "false", "ns", "valid");
+	printf("%-24s %8u %8u %8u %8u %8u %10llu %-5s\n", config, words * 4, codePointers, SCAN_CALLS, found, falsePositives,
+	       (unsigned long long)bench.nanoseconds, bench.valid ? "yes" : "no");
+}
+
+/**
+ * the latency from the entry of each exception that saves a dump to the reset,
+ * with the source read back from the dump
+ */
+static void prvBenchSources(void)
+{
+	static const struct {
+		const char* name;
+		uint32_t source;
+	} sources[] = {
+		{"NMI", HARDFAULT_SOURCE_NMI},
+		{"HardFault", HARDFAULT_SOURCE_HARDFAULT},
+		{"MemManage", HARDFAULT_SOURCE_MEMMANAGE},
+		{"BusFault", HARDFAULT_SOURCE_BUSFAULT},
+		{"UsageFault", HARDFAULT_SOURCE_USAGEFAULT},
+	};
+	const uint32_t words = 1024 / sizeof(uint32_t);
+	printf("%-24s %-10s %10s %10s %8s %-6s %-5s\n", "config", "source", "cycles", "ns", "bytes", "source", "valid");
+	for (uint32_t i = 0; i < sizeof(sources) / sizeof(sources[0]); i++)
+	{
+		hostSim_fault_t fault = prvFault(words);
+		fault.faultSource = sources[i].source;
+		bench_result_t bench = prvCapture(&fault);
+		printf("%-24s %-10s %10u %10llu %8u %-6s %-5s\n", config, sources[i].name, bench.last.cycles,
+		       (unsigned long long)bench.nanoseconds, bench.last.bytesWritten,
+		       bench.last.faultSource == sources[i].source ? "yes" : "no", bench.valid ? "yes" : "no");
+	}
+}
+
+// --------------------------------------------------------------------------------------
+
+static const struct {
+	const char* name;
+	void (*run)(void);
+} benchmarks[] = {
+	{"erase", prvBenchErase},
+	{"backends", prvBenchBackends},
+	{"pipeline", prvBenchPipeline},
+	{"rle", prvBenchRle},
+	{"crc", prvBenchCrc},
+	{"copy", prvBenchCopy},
+	{"scan", prvBenchScan},
+	{"sources", prvBenchSources},
+};
+
+int main(int argc, char** argv)
+{
+	if (argc < 3)
+	{
+		fprintf(stderr, "usage: %s <configuration name> <benchmark>...\n", argv[0]);
+		return 1;
+	}
+	config = argv[1];
+	if (!hostSim_mapRam())
+	{
+		fprintf(stderr, "can't map the simulated RAM at 0x%08x\n", HOSTSIM_RAM_BASE);
+		return 1;
+	}
+	for (int arg = 2; arg < argc; arg++)
+	{
+		uint32_t i = 0;
+		while (i < sizeof(benchmarks) / sizeof(benchmarks[0]) && strcmp(benchmarks[i].name, argv[arg]) != 0)
+			i++;
+		if (i == sizeof(benchmarks) / sizeof(benchmarks[0]))
+		{
+			fprintf(stderr, "unknown benchmark %s\n", argv[arg]);
+			return 1;
+		}
+		benchmarks[i].run();
+	}
+	return 0;
+}
@@ -0,0 +1,262 @@
+/**
+ * The driver of the host simulation: places a fault on the simulated RAM, sets the device state the shims of the handler
+ * read, runs the capture, then reboots the handler and checks the dump it reads back against the fault.
+ * The capture itself is the code of hardFault_handler.c, this file only uses its public interface.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <setjmp.h>
+#include <time.h>
+#include <sys/mman.h>
+#include "hardFault_handler.h"
+#include "hostSim.h"
+
+#ifndef MIN
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#endif
+
+hostSim_SCB_t hostSim_SCB;
+hostSim_FPU_t hostSim_FPU;
+uint32_t hostSim_fpuRegisters[32];
+uint32_t hostSim_FPSCR;
+uint32_t hostSim_PSP;
+uint32_t hostSim_IPSR;
+uint32_t hostSim_mainStackBase;
+uint32_t hostSim_exidxStart;
+uint32_t hostSim_exidxEnd;
+
+static jmp_buf hostSim_resetPoint;
+
+uint32_t hostSim_stack[HOSTSIM_STACK_WORDS];
+
+hostSim_fault_t hostSim_makeFault(uint32_t words, uint32_t stackBase, uint32_t excReturn)
+{
+	uint32_t seed = 0x12345678;
+	for (uint32_t i = 0; i < words; i++)
+	{
+		seed = seed * 1664525 + 1013904223;
+		hostSim_stack[i] = (i % 16 < 6) ? 0 : seed;
+	}
+	hostSim_stack[7] = 0x01000000; // xPSR: thumb, no alignment padding
+
+	hostSim_fault_t fault = {
+		.stack = hostSim_stack,
+		.stackWords = words,
+		.stackBase = stackBase,
+		.excReturn = excReturn,
+		.calleeRegisters = {4, 5, 6, 7, 8, 9, 10, 11},
+		.SCB_registers = {.CFSR = 0x400, .HFSR = 0x40000000},
+	};
+	return fault;
+}
+
+/**
+ * map the simulated RAM, once
+ */
+bool hostSim_mapRam(void)
+{
+	static bool mapped = false;
+	if (!mapped)
+	{
+		void* ram = mmap((void*)(uintptr_t)HOSTSIM_RAM_BASE, PROG_RAM_END - HOSTSIM_RAM_BASE, PROT_READ | PROT_WRITE,
+		                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+		mapped = (ram == (void*)(uintptr_t)HOSTSIM_RAM_BASE);
+	}
+	return mapped;
+}
+
+uint64_t hostSim_nanoseconds(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000000u + now.tv_nsec;
+}
+
+void hostSim_reset(void)
+{
+	longjmp(hostSim_resetPoint, 1);
+}
+
+/**
+ * check the newest dump against the fault and the simulated RAM it was taken from
+ * and describe it in the result
+ */
+static bool prvCheckDump(const hostSim_fault_t* fault, uint32_t sp, hostSim_result_t* result)
+{
+	static uint8_t* dump;
+	static uint8_t stack[HOSTSIM_RAM_SIZE];
+	if (dump == NULL)
+		dump = malloc(hostSim_storage.slotSize);
+	if (dump == NULL)
+		return false;
+
+	hardFault_dumpIterator_t iterator;
+	hardFault_dumpCursor_t cursor;
+	uint64_t startTime = hostSim_nanoseconds();
+	hardFault_dumpIteratorInit(&iterator);
+	bool read = hardFault_dumpIteratorNextCursor(&iterator, &cursor);
+	if (read)
+		hardFault_dumpCursorRead(&cursor, dump, hostSim_storage.slotSize);
+	result->readNanoseconds += hostSim_nanoseconds() - startTime;
+	if (!read)
+		return false;
+
+	result->bytesWritten = hostSim_storage.slotHeaderSize + iterator.length;
+	result->flags = iterator.flags;
+	result->faultSource = iterator.faultSource;
+	if (!hardFault_dumpCursorValid(&cursor))
+		return false;
+
+	const core_dump_t* core_dump = (const core_dump_t*)dump;
+	if (memcmp(&core_dump->SCB_registers, &fault->SCB_registers, sizeof(SCB_registers_t)) != 0 ||
+	    memcmp(&core_dump->extended_registers, fault->calleeRegisters, sizeof(fault->calleeRegisters)) != 0 ||
+	    core_dump->extended_registers.EXC_RETURN != fault->excReturn)
+		return false;
+	if (iterator.flags & DUMP_FLAG_STACKING_ERROR)
+	{
+		uint32_t savedSp;
+		memcpy(&savedSp, core_dump->context_stack, sizeof(savedSp));
+		result->contextStack = core_dump->context_stack;
+		result->contextStackLength = iterator.length - sizeof(core_dump_t);
+		return iterator.length == sizeof(core_dump_t) + sizeof(savedSp) && savedSp == sp;
+	}
+	if (memcmp(&core_dump->core_registers, fault->stack, sizeof(core_registers_t)) != 0)
+		return false;
+
+	const uint8_t* context_stack = core_dump->context_stack;
+	uint32_t length = iterator.length - sizeof(core_dump_t);
+	if (iterator.flags & DUMP_FLAG_FPU)
+	{
+		memcpy(result->fpuRegisters, context_stack, sizeof(fpu_registers_t));
+		context_stack += sizeof(fpu_registers_t);
+		length -= sizeof(fpu_registers_t);
+	}
+	if (iterator.flags & DUMP_FLAG_BACKTRACE)
+	{
+		uint32_t depth;
+		memcpy(&depth, context_stack, sizeof(depth));
+		result->backtrace = (const uint32_t*)(context_stack + sizeof(backtrace_t));
+		result->backtraceDepth = depth;
+		context_stack += sizeof(backtrace_t) + depth * sizeof(uint32_t);
+		length -= sizeof(backtrace_t) + depth * sizeof(uint32_t);
+	}
+	if (iterator.flags & DUMP_FLAG_REGIONS)
+	{
+		uint32_t regionsLength = hardFault_sectionTableLength(context_stack, length);
+		if (regionsLength == 0)
+			return false;
+		context_stack += regionsLength;
+		length -= regionsLength;
+	}
+	result->contextStack = context_stack;
+	result->contextStackLength = length;
+	if (iterator.flags & DUMP_FLAG_STACK_RLE)
+	{
+		length = hardFault_decodeStack(context_stack, length, stack, sizeof(stack));
+		context_stack = stack;
+	}
+	if (iterator.flags & DUMP_FLAG_STACK_COMPACT)
+	{
+		/* only the raw part can be compared with the stack */
+		uint32_t rawLength;
+		memcpy(&rawLength, context_stack, sizeof(rawLength));
+		context_stack += sizeof(rawLength);
+		length = MIN(rawLength, length - sizeof(rawLength));
+	}
+	if (iterator.flags & DUMP_FLAG_SECTIONS)
+	{
+		uint32_t count;
+		memcpy(&count, context_stack, sizeof(count));
+		const uint8_t* data = context_stack + sizeof(count) + count * sizeof(dump_section_t);
+		for (uint32_t i = 0; i < count; i++)
+		{
+			dump_section_t section;
+			memcpy(&section, context_stack + sizeof(count) + i * sizeof(dump_section_t), sizeof(section));
+			if (memcmp(data, (const void*)(uintptr_t)section.address, section.length) != 0)
+				return false;
+			data += section.length;
+			if (section.tag & DUMP_SECTION_ACTIVE)
+				result->stackBytes += section.length;
+		}
+		return data == core_dump->context_stack + iterator.length - sizeof(core_dump_t);
+	}
+	if (iterator.flags & DUMP_FLAG_STACK_SPLIT)
+	{
+		for (uint32_t i = 0; i < 2; i++)
+		{
+			stack_window_t window;
+			memcpy(&window, context_stack, sizeof(window));
+			context_stack += sizeof(window);
+			if (memcmp(context_stack, (const void*)(uintptr_t)window.address, window.length) != 0)
+				return false;
+			context_stack += window.length;
+			result->stackBytes += window.length;
+		}
+		return true;
+	}
+	result->stackBytes = length;
+	return memcmp(context_stack, (const void*)(uintptr_t)(sp + sizeof(core_registers_t)), length) == 0;
+}
+
+bool hostSim_fault(const hostSim_fault_t* fault, hostSim_result_t* result)
+{
+	uint32_t stackSize = fault->stackWords * sizeof(uint32_t);
+	uint32_t sp = fault->corruptedSp ? fault->corruptedSp : fault->stackBase - stackSize;
+	if (!hostSim_mapRam())
+		return false;
+	if (fault->corruptedSp == 0)
+	{
+		if (fault->stackWords < 8 || fault->stackBase > PROG_RAM_END || fault->stackBase - HOSTSIM_RAM_BASE < stackSize)
+			return false;
+		memcpy((void*)(uintptr_t)sp, fault->stack, stackSize);
+	}
+	hostSim_SCB = fault->SCB_registers;
+	memcpy(hostSim_fpuRegisters, fault->fpuRegisters, sizeof(hostSim_fpuRegisters));
+	hostSim_FPSCR = fault->FPSCR;
+	hostSim_FPU.FPCCR = fault->lazyStacking ? HOSTSIM_FPCCR_LSPACT : 0;
+	hostSim_IPSR = fault->faultSource ? fault->faultSource : HARDFAULT_SOURCE_HARDFAULT;
+	hostSim_exidxStart = fault->exidxStart;
+	hostSim_exidxEnd = fault->exidxEnd;
+#if HARDFAULT_BACKTRACE == 2 || HARDFAULT_STACK_TRUNCATION == 1 // HARDFAULT_BACKTRACE_SCAN, HARDFAULT_TRUNCATE_COMPACT
+	if (fault->codeEnd != 0)
+	{
+		hardFault_codeRange_t code = {fault->codeStart, fault->codeEnd};
+		hardFault_setCodeRanges(&code, 1);
+	}
+#endif
+	if (fault->excReturn & EXC_RETURN_PROCESS_STACK)
+	{
+		hostSim_PSP = sp;
+		hostSim_mainStackBase = fault->otherStack ? fault->otherStack : PROG_RAM_END;
+	}
+	else
+	{
+		hostSim_PSP = fault->otherStack;
+		hostSim_mainStackBase = fault->stackBase;
+	}
+
+	uint32_t startCycles = hostSim_cycles;
+	hostSim_headerStart = hostSim_cycles;
+	uint64_t startTime = hostSim_nanoseconds();
+	if (setjmp(hostSim_resetPoint) == 0)
+		hostSim_capture((uint32_t*)(uintptr_t)sp, fault->calleeRegisters, fault->excReturn);
+	result->nanoseconds = hostSim_nanoseconds() - startTime;
+	result->cycles = hostSim_cycles - startCycles;
+	result->headerCycles = hostSim_headerStart != startCycles ? hostSim_cycles - hostSim_headerStart : 0; // only the internal flash records it
+	result->FPCCR = hostSim_FPU.FPCCR;
+
+	/* reboot */
+	uint64_t bootTime = hostSim_nanoseconds();
+	hardFault_init();
+	result->readNanoseconds = hostSim_nanoseconds() - bootTime;
+	result->bytesWritten = 0;
+	result->flags = 0;
+	result->faultSource = 0;
+	result->stackBytes = 0;
+	result->contextStack = NULL;
+	result->contextStackLength = 0;
+	result->backtrace = NULL;
+	result->backtraceDepth = 0;
+	result->valid = prvCheckDump(fault, sp, result);
+	return true;
+}
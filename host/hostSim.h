@@ -0,0 +1,189 @@
+/**
+ * Host simulation of the hardfault handler
+ * hardFault_handler.c built with HARDFAULT_HOST_SIM runs its capture on a Linux host, on a simulated RAM and storage.
+ * Build it together with hostSim.c and hostSim_devices.c, all with the same configuration, and drive it with hostSim_fault.
+ * The Makefile builds test.c, the regression tests, for several configurations: make -C host test
+ */
+#ifndef HOSTSIM_H
+#define HOSTSIM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * The simulated RAM, mapped at its device address so the addresses keep fitting in 32 bits.
+ * The stacks of the simulated faults are placed below PROG_RAM_END, the RAM above it is reserved for the dumps.
+ */
+#ifndef HOSTSIM_RAM_BASE
+#define HOSTSIM_RAM_BASE 0x20000000
+#endif
+#ifndef HOSTSIM_RAM_SIZE
+#define HOSTSIM_RAM_SIZE 0x20000
+#endif
+#ifndef RAM_END
+#define RAM_END (HOSTSIM_RAM_BASE + HOSTSIM_RAM_SIZE)
+#define PROG_RAM_END (RAM_END - 0x8000)
+#endif
+
+/**
+ * The cost of copying a byte to the staging buffer of the internal flash, in simulated CPU cycles
+ */
+#ifndef HOSTSIM_COPY_CYCLES_PER_BYTE
+#define HOSTSIM_COPY_CYCLES_PER_BYTE 1
+#endif
+
+/**
+ * The fault status registers of the SCB, in the order of SCB_registers_t
+ */
+typedef struct hostSim_SCB_t {
+	uint32_t CFSR;
+	uint32_t HFSR;
+	uint32_t DFSR;
+	uint32_t MMFAR;
+	uint32_t BFAR;
+	uint32_t AFSR;
+}hostSim_SCB_t;
+
+/**
+ * a fault to simulate
+ */
+typedef struct hostSim_fault_t {
+	const uint32_t* stack;         // the stack from the fault sp: the exception frame (8 words, or 26 with S0-S15 and FPSCR) and the caller's frames
+	uint32_t stackWords;
+	uint32_t stackBase;            // the stack is placed right below this address of the simulated RAM
+	uint32_t excReturn;            // bit 2 selects the stack: the PSP (a task) or the MSP
+	uint32_t calleeRegisters[8];   // R4-R11
+	hostSim_SCB_t SCB_registers;
+	uint32_t faultSource;          // HARDFAULT_SOURCE_xxx, the exception to simulate (0 for a HardFault)
+	uint32_t otherStack;           // main stack fault: the PSP of the interrupted task (0 for none), task fault: the base of the main stack (0 for PROG_RAM_END)
+	uint32_t corruptedSp;          // non zero: the sp of a stacking error (CFSR MSTKERR/STKERR), used as is instead of placing the stack
+	uint32_t exidxStart;           // HARDFAULT_BACKTRACE_EHABI: the .ARM.exidx section, loaded by the caller at its device address
+	uint32_t exidxEnd;
+	uint32_t codeStart;            // HARDFAULT_BACKTRACE_SCAN, HARDFAULT_TRUNCATE_COMPACT: the code range set with hardFault_setCodeRanges, 0 to keep the current ranges
+	uint32_t codeEnd;
+	uint32_t fpuRegisters[32];     // S0-S31 held by the FPU at the fault
+	uint32_t FPSCR;                // the FPSCR held by the FPU at the fault
+	bool lazyStacking;             // FPCCR.LSPACT: S0-S15 and FPSCR of the extended frame weren't stacked yet, they are still in the FPU
+}hostSim_fault_t;
+
+typedef struct hostSim_result_t {
+	uint32_t cycles;       // simulated device cycles, from the storage model
+	uint32_t headerCycles; // the part of cycles spent writing the header to the internal flash, after the phases of DUMP_FLAG_PHASE_TIMING ended
+	uint64_t nanoseconds;  // host time spent in the capture
+	uint64_t readNanoseconds; // host time spent reading the dump back after the reset: hardFault_init and the iterator
+	uint32_t bytesWritten; // dump length including its header
+	bool valid;            // the dump read back after the reset matches the fault
+	uint32_t flags;        // the DUMP_FLAG_xxx of the dump
+	uint32_t faultSource;  // the HARDFAULT_SOURCE_xxx of the dump
+	uint32_t stackBytes;   // the bytes of the violating stack the dump holds, once decoded, after the exception frame (the DUMP_SECTION_ACTIVE section)
+	const uint8_t* contextStack; // the context stack of the dump, after the optional blocks, valid until the next fault
+	uint32_t contextStackLength;
+	uint32_t fpuRegisters[33];   // DUMP_FLAG_FPU: S0-S31 and FPSCR of the dump
+	const uint32_t* backtrace;   // DUMP_FLAG_BACKTRACE: the addresses of the backtrace, valid until the next fault
+	uint32_t backtraceDepth;
+	uint32_t FPCCR;              // the FPCCR after the capture
+}hostSim_result_t;
+
+#define HOSTSIM_FPCCR_LSPACT (1UL << 0) // FPCCR.LSPACT, lazy stacking is pending
+
+/**
+ * The stack image of the faults made by hostSim_makeFault
+ */
+#define HOSTSIM_STACK_WORDS 8192
+extern uint32_t hostSim_stack[HOSTSIM_STACK_WORDS];
+
+/**
+ * a fault on the first words of hostSim_stack, filled like a running program: words that were never used (zero) and random words.
+ * The caller can change the stack image and the fault before simulating it.
+ */
+hostSim_fault_t hostSim_makeFault(uint32_t words, uint32_t stackBase, uint32_t excReturn);
+
+/**
+ * map the simulated RAM, hostSim_fault does it as well
+ * return - false if the RAM can't be mapped at HOSTSIM_RAM_BASE
+ */
+bool hostSim_mapRam(void);
+
+/**
+ * place the fault's stack on the simulated RAM, run the capture as the HardFault_Handler would,
+ * then reboot (hardFault_init) and read the dump back
+ * return - false if the fault doesn't fit in the simulated RAM
+ */
+bool hostSim_fault(const hostSim_fault_t* fault, hostSim_result_t* result);
+
+/**
+ * host time, in nanoseconds
+ */
+uint64_t hostSim_nanoseconds(void);
+
+// --------------------------------------------------------------------------------------
+// the shims of the handler, hardFault_handler.c
+
+typedef struct hostSim_FPU_t {
+	uint32_t FPCCR;
+}hostSim_FPU_t;
+
+/* the device state the capture reads, set by hostSim_fault for each fault */
+extern hostSim_SCB_t hostSim_SCB;
+extern hostSim_FPU_t hostSim_FPU;
+extern uint32_t hostSim_fpuRegisters[32]; // S0-S31
+extern uint32_t hostSim_FPSCR;
+extern uint32_t hostSim_PSP;
+extern uint32_t hostSim_IPSR;
+extern uint32_t hostSim_mainStackBase;
+extern uint32_t hostSim_exidxStart;
+extern uint32_t hostSim_exidxEnd;
+
+/**
+ * NVIC_SystemReset: returns to hostSim_fault, which then reboots the handler
+ */
+void hostSim_reset(void) __attribute__((noreturn));
+
+/**
+ * run the capture as the HardFault_Handler does once it has pushed R4-R11, it ends with NVIC_SystemReset
+ */
+void hostSim_capture(uint32_t* sp, const uint32_t* calleeRegisters, uint32_t excReturn);
+
+/**
+ * copy with the libc free routine of the capture, prvFaultSafeCopy
+ */
+void hostSim_faultSafeCopy(void* destination, const void* source, uint32_t length);
+
+/**
+ * update a CRC-32 with more data using the HARDFAULT_CRC_ENGINE of the build, start with crc = 0
+ */
+uint32_t hostSim_crc32(uint32_t crc, const void* data, uint32_t length);
+
+// --------------------------------------------------------------------------------------
+// the simulated devices, hostSim_devices.c
+
+/**
+ * The reserved region of the selected backend, defined by the handler
+ */
+typedef struct hostSim_storage_t {
+	uint8_t* data;      // the host array holding the region
+	uint32_t address;   // the device address of the region
+	uint32_t size;
+	uint32_t eraseUnit; // HARDFAULT_STORAGE_ERASE_UNIT, the page or sector size of the flash
+	uint32_t writeUnit; // HARDFAULT_STORAGE_WRITE_UNIT, the program unit of the flash
+	uint32_t slotCount; // HARDFAULT_SLOT_COUNT
+	uint32_t slotSize;  // HARDFAULT_SLOT_SIZE
+	uint32_t slotHeaderSize; // the dump_header_t at the start of each slot, padded to writeUnit
+}hostSim_storage_t;
+
+extern const hostSim_storage_t hostSim_storage;
+
+typedef struct hostSim_storageStats_t {
+	uint32_t eraseCount;
+	uint32_t bytesErased;
+	uint32_t programCount;
+	uint32_t bytesProgrammed;
+	uint32_t bytesRead;
+}hostSim_storageStats_t;
+
+extern hostSim_storageStats_t hostSim_storageStats;
+extern uint32_t hostSim_cycles; // simulated time, advanced by the device models
+extern uint32_t hostSim_headerStart; // hostSim_cycles when the internal flash started programming the last header of a slot
+extern bool hostSim_dmaFail;    // the next DMA transfer fails
+
+#endif
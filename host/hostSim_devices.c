@@ -0,0 +1,188 @@
+/**
+ * The simulated devices of the host simulation: the storage backends, the DMA and the CRC peripheral.
+ * They implement the device specific methods the handler declares, on the host array of hostSim_storage.
+ * All the models are built, the handler calls only those of the selected backend.
+ */
+#include <string.h>
+#include "hostSim.h"
+
+#ifndef MIN
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#endif
+
+hostSim_storageStats_t hostSim_storageStats;
+uint32_t hostSim_cycles;
+uint32_t hostSim_headerStart;
+bool hostSim_dmaFail;
+
+static inline uint8_t* prvStoragePtr(uint32_t address)
+{
+	return &hostSim_storage.data[address - hostSim_storage.address];
+}
+
+// --------------------------------------------------------------------------------------
+// internal flash
+
+/**
+ * Simulated flash timing, in CPU cycles. The defaults are typical for an 80MHz part:
+ * 22ms page erase and 82us per 64bit program unit.
+ * HOSTSIM_FLASH_SYNC models a part where programming stalls the CPU: flash_programStart returns once it's done.
+ */
+#ifndef HOSTSIM_FLASH_ERASE_CYCLES
+#define HOSTSIM_FLASH_ERASE_CYCLES 1760000
+#endif
+#ifndef HOSTSIM_FLASH_PROGRAM_UNIT_CYCLES
+#define HOSTSIM_FLASH_PROGRAM_UNIT_CYCLES 6560
+#endif
+#ifndef HOSTSIM_FLASH_SYNC
+#define HOSTSIM_FLASH_SYNC 0
+#endif
+
+static uint32_t hostSim_flashBusyUntil;
+static uint32_t hostSim_flashStalled; // the cycles the CPU waited for the flash since the last program started
+
+void flash_waitReady(void)
+{
+	if ((int32_t)(hostSim_flashBusyUntil - hostSim_cycles) > 0)
+	{
+		hostSim_flashStalled += hostSim_flashBusyUntil - hostSim_cycles;
+		hostSim_cycles = hostSim_flashBusyUntil;
+	}
+}
+
+void flash_erasePage(uint32_t pageAddress)
+{
+	flash_waitReady();
+	memset(prvStoragePtr(pageAddress), 0xFF, hostSim_storage.eraseUnit);
+	hostSim_cycles += HOSTSIM_FLASH_ERASE_CYCLES;
+	hostSim_flashStalled = 0;
+	hostSim_storageStats.eraseCount++;
+	hostSim_storageStats.bytesErased += hostSim_storage.eraseUnit;
+}
+
+void flash_programStart(uint32_t address, const void* data, uint32_t length)
+{
+	if ((address - hostSim_storage.address) % hostSim_storage.slotSize == 0)
+		hostSim_headerStart = hostSim_cycles;
+	flash_waitReady();
+	/* the handler copied the data to its staging buffer while the previous program ran,
+	 * the copy takes the time the CPU then waited for the flash, and the rest on top of it */
+	uint32_t copy = length * HOSTSIM_COPY_CYCLES_PER_BYTE;
+	hostSim_cycles += copy - MIN(copy, hostSim_flashStalled);
+	/* programming can only clear bits, just like the real flash */
+	for (uint32_t i = 0; i < length; i++)
+		prvStoragePtr(address)[i] &= ((const uint8_t*)data)[i];
+	hostSim_flashBusyUntil = hostSim_cycles + (length / hostSim_storage.writeUnit) * HOSTSIM_FLASH_PROGRAM_UNIT_CYCLES;
+#if HOSTSIM_FLASH_SYNC
+	hostSim_cycles = hostSim_flashBusyUntil;
+#endif
+	hostSim_flashStalled = 0;
+	hostSim_storageStats.programCount++;
+	hostSim_storageStats.bytesProgrammed += length;
+}
+
+// --------------------------------------------------------------------------------------
+// SPI NOR flash
+
+void spiNor_eraseSector(uint32_t sectorAddress)
+{
+	memset(prvStoragePtr(sectorAddress), 0xFF, hostSim_storage.eraseUnit);
+	hostSim_storageStats.eraseCount++;
+	hostSim_storageStats.bytesErased += hostSim_storage.eraseUnit;
+}
+
+void spiNor_program(uint32_t address, const void* data, uint32_t length)
+{
+	for (uint32_t i = 0; i < length; i++)
+		prvStoragePtr(address)[i] &= ((const uint8_t*)data)[i];
+	hostSim_storageStats.programCount++;
+	hostSim_storageStats.bytesProgrammed += length;
+}
+
+void spiNor_read(uint32_t address, void* data, uint32_t length)
+{
+	memcpy(data, prvStoragePtr(address), length);
+	hostSim_storageStats.bytesRead += length;
+}
+
+// --------------------------------------------------------------------------------------
+// FRAM
+
+void fram_write(uint32_t address, const void* data, uint32_t length)
+{
+	memcpy(prvStoragePtr(address), data, length);
+	hostSim_storageStats.programCount++;
+	hostSim_storageStats.bytesProgrammed += length;
+}
+
+void fram_read(uint32_t address, void* data, uint32_t length)
+{
+	memcpy(data, prvStoragePtr(address), length);
+	hostSim_storageStats.bytesRead += length;
+}
+
+// --------------------------------------------------------------------------------------
+// CRC peripheral
+
+/**
+ * The cost of the CRC peripheral in CPU cycles per 32bit word fed to it
+ */
+#ifndef HOSTSIM_CRC_CYCLES_PER_WORD
+#define HOSTSIM_CRC_CYCLES_PER_WORD 4
+#endif
+
+/**
+ * reflected CRC-32 with polynomial 0x04C11DB7, computed bit by bit as the peripheral shifts it
+ */
+uint32_t crc_hwUpdate(uint32_t crc, const void* data, uint32_t length)
+{
+	const uint8_t* bytes = data;
+	crc = ~crc;
+	for (uint32_t i = 0; i < length; i++)
+	{
+		crc ^= bytes[i];
+		for (uint32_t bit = 0; bit < 8; bit++)
+			crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+	}
+	hostSim_cycles += (length + 3) / 4 * HOSTSIM_CRC_CYCLES_PER_WORD;
+	return ~crc;
+}
+
+// --------------------------------------------------------------------------------------
+// DMA
+
+#ifndef HOSTSIM_DMA_BYTES_PER_CYCLE
+#define HOSTSIM_DMA_BYTES_PER_CYCLE 2
+#endif
+
+/**
+ * The simulated DMA moves the data only when dma_waitDone is called,
+ * so reading the destination before waiting returns stale data just like a real transfer in progress
+ */
+static struct {
+	uint32_t destination;
+	const void* source;
+	uint32_t length;
+	uint32_t doneAt;
+} hostSim_dma;
+
+void dma_copyStart(uint32_t destination, const void* source, uint32_t length)
+{
+	hostSim_dma.destination = destination;
+	hostSim_dma.source = source;
+	hostSim_dma.length = length;
+	hostSim_dma.doneAt = hostSim_cycles + length / HOSTSIM_DMA_BYTES_PER_CYCLE;
+}
+
+bool dma_waitDone(void)
+{
+	if ((int32_t)(hostSim_dma.doneAt - hostSim_cycles) > 0)
+		hostSim_cycles = hostSim_dma.doneAt;
+	if (hostSim_dmaFail)
+	{
+		hostSim_dmaFail = false;
+		return false;
+	}
+	memcpy(prvStoragePtr(hostSim_dma.destination), hostSim_dma.source, hostSim_dma.length);
+	return true;
+}
@@ -0,0 +1,888 @@
+/**
+ * Regression tests of the hardfault handler, on the host simulation
+ * Each scenario simulates a fault, then checks the dump read back after the reset.
+ * Prints a row per scenario: the configuration, the scenario, the simulated cycles and host time of the capture,
+ * the bytes written and whether the dump is valid.
+ * usage: test <configuration name>
+ * return - 0 if all the scenarios pass
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stddef.h>
+#include "hardFault_handler.h"
+#include "hostSim.h"
+
+#define EXC_RETURN_HANDLER_MSP 0xFFFFFFF1
+#define EXC_RETURN_THREAD_MSP  0xFFFFFFF9
+#define EXC_RETURN_THREAD_PSP  0xFFFFFFFD
+#define EXC_RETURN_HANDLER_MSP_FPU 0xFFFFFFE1 // the exception frame includes S0-S15 and FPSCR
+#define EXC_RETURN_THREAD_MSP_FPU  0xFFFFFFE9
+#define EXC_RETURN_THREAD_PSP_FPU  0xFFFFFFED
+
+#define MAIN_STACK_BASE (PROG_RAM_END)
+#define TASK_STACK_BASE (HOSTSIM_RAM_BASE + 0x8000)
+
+static const char* config = "";
+static int failures;
+static void prvReport(const char* scenario, const hostSim_result_t* result, bool pass)
+{
+	printf("%-8s %-24s %10u %10llu %8u %-5s %s\n", config, scenario, result->cycles,
+	       (unsigned long long)result->nanoseconds, result->bytesWritten, result->valid ? "yes" : "no", pass ? "PASS" : "FAIL");
+	if (!pass)
+		failures++;
+}
+
+/**
+ * simulate the fault and check that the dump is valid and holds the expected bytes of stack after the exception frame
+ */
+static void prvRun(const char* scenario, const hostSim_fault_t* fault, uint32_t expectedStackBytes)
+{
+#if HARDFAULT_CAPTURE_BOTH_STACKS
+	/* the stack of the violating context is cut to its budget */
+	uint32_t budget = (fault->excReturn & EXC_RETURN_PROCESS_STACK) ? HARDFAULT_PSP_SECTION_BUDGET : HARDFAULT_MSP_SECTION_BUDGET;
+	if (expectedStackBytes > budget)
+		expectedStackBytes = budget;
+#endif
+	hostSim_result_t result = {0};
+	bool pass = hostSim_fault(fault, &result) && result.valid && result.stackBytes == expectedStackBytes;
+	prvReport(scenario, &result, pass);
+}
+
+#if HARDFAULT_CAPTURE_BOTH_STACKS
+/**
+ * check the table of a context stack saved in the format of DUMP_FLAG_SECTIONS
+ */
+static bool prvCheckSections(const hostSim_result_t* result, const dump_section_t* expected, uint32_t count)
+{
+	uint32_t savedCount;
+	if (result->contextStackLength < sizeof(savedCount))
+		return false;
+	memcpy(&savedCount, result->contextStack, sizeof(savedCount));
+	if (savedCount != count || result->contextStackLength < sizeof(savedCount) + count * sizeof(dump_section_t))
+		return false;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		dump_section_t section;
+		memcpy(&section, result->contextStack + sizeof(savedCount) + i * sizeof(dump_section_t), sizeof(section));
+		if (section.tag != expected[i].tag || section.address != expected[i].address || section.length != expected[i].length)
+			return false;
+	}
+	return true;
+}
+#endif
+
+// --------------------------------------------------------------------------------------
+
+static void prvTestMainStack(void)
+{
+	hostSim_fault_t fault = hostSim_makeFault(64, MAIN_STACK_BASE, EXC_RETURN_THREAD_MSP);
+	prvRun("msp", &fault, (64 - 8) * sizeof(uint32_t));
+}
+
+/**
+ * the task stacks aren't registered, the handler saves HARDFAULT_TASK_STACK_FIXED_SIZE from the sp
+ */
+static void prvTestTaskStack(void)
+{
+	hostSim_fault_t fault = hostSim_makeFault(256, TASK_STACK_BASE, EXC_RETURN_THREAD_PSP);
+	prvRun("psp", &fault, (256 - 8) * sizeof(uint32_t));
+}
+
+/**
+ * every EXC_RETURN of a fault: the saved stack must run from the sp to the base of the stack EXC_RETURN selects
+ */
+static void prvTestExcReturn(void)
+{
+	static const struct {
+		const char* name;
+		uint32_t excReturn;
+	} cases[] = {
+		{"exc_return F1", EXC_RETURN_HANDLER_MSP},
+		{"exc_return F9", EXC_RETURN_THREAD_MSP},
+		{"exc_return FD", EXC_RETURN_THREAD_PSP},
+		{"exc_return E1", EXC_RETURN_HANDLER_MSP_FPU},
+		{"exc_return E9", EXC_RETURN_THREAD_MSP_FPU},
+		{"exc_return ED", EXC_RETURN_THREAD_PSP_FPU},
+	};
+	for (uint32_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+	{
+		bool task = (cases[i].excReturn & EXC_RETURN_PROCESS_STACK) != 0;
+		/* the task stacks are HARDFAULT_TASK_STACK_FIXED_SIZE, the main stack ends at its base */
+		uint32_t words = task ? 256 : 96;
+		hostSim_fault_t fault = hostSim_makeFault(words, task ? TASK_STACK_BASE : MAIN_STACK_BASE, cases[i].excReturn);
+		prvRun(cases[i].name, &fault, (words - 8) * sizeof(uint32_t));
+	}
+}
+
+/**
+ * main stack faults while the PSP holds the same value as the sp,
+ * the stack must still be saved up to the base of the main stack and not as a task stack
+ */
+static void prvTestMainStackEqualsPsp(void)
+{
+	static const struct {
+		const char* name;
+		uint32_t excReturn;
+	} cases[] = {
+		{"msp == psp F1", EXC_RETURN_HANDLER_MSP},
+		{"msp == psp F9", EXC_RETURN_THREAD_MSP},
+		{"msp == psp E9", EXC_RETURN_THREAD_MSP_FPU},
+	};
+	for (uint32_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+	{
+		uint32_t words = 64;
+		hostSim_fault_t fault = hostSim_makeFault(words, MAIN_STACK_BASE, cases[i].excReturn);
+		fault.otherStack = MAIN_STACK_BASE - words * sizeof(uint32_t);
+		prvRun(cases[i].name, &fault, (words - 8) * sizeof(uint32_t));
+	}
+}
+
+/**
+ * the hardware failed to push the exception frame, the sp points outside the memory.
+ * The dump must hold only the sp: reading the frame from these addresses would fault the host as well.
+ */
+static void prvTestStackingError(void)
+{
+	static const struct {
+		const char* name;
+		uint32_t sp;
+		uint32_t CFSR;
+		uint32_t excReturn;
+	} cases[] = {
+		{"stacking error 1FFFFFE0", 0x1FFFFFE0, CFSR_MSTKERR, EXC_RETURN_THREAD_MSP}, // the main stack overflowed below the RAM
+		{"stacking error 00000010", 0x00000010, CFSR_STKERR, EXC_RETURN_THREAD_PSP},
+		{"stacking error DEADBEE0", 0xDEADBEE0, CFSR_STKERR, EXC_RETURN_THREAD_PSP},
+	};
+	for (uint32_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+	{
+		hostSim_fault_t fault = hostSim_makeFault(8, MAIN_STACK_BASE, cases[i].excReturn);
+		fault.corruptedSp = cases[i].sp;
+		fault.SCB_registers.CFSR = cases[i].CFSR;
+		hostSim_result_t result = {0};
+		bool pass = hostSim_fault(&fault, &result) && result.valid && (result.flags & DUMP_FLAG_STACKING_ERROR);
+		uint32_t savedSp = 0;
+		if (pass && result.contextStackLength == sizeof(savedSp))
+			memcpy(&savedSp, result.contextStack, sizeof(savedSp));
+		prvReport(cases[i].name, &result, pass && savedSp == cases[i].sp);
+	}
+}
+
+#if HARDFAULT_TASK_STACK_MODE == 1
+/**
+ * task faults with registered task stacks, the stack must be saved from the sp to the end of the task's stack
+ */
+static void prvTestRegisteredTaskStacks(void)
+{
+	static const struct {
+		const char* name;
+		uint32_t start;   // the registered stack, 0 for none
+		uint32_t end;
+		uint32_t sp;
+		uint32_t copied;  // the bytes from the sp to the end of the stack
+	} cases[] = {
+		{"task frame only", 0x20000000, 0x20000400, 0x200003E0, 32},
+		{"task 8KB stack", 0x20002000, 0x20004000, 0x20002100, 7936},
+		{"task unregistered", 0, 0, 0x20005C00, 1024}, // HARDFAULT_TASK_STACK_FIXED_SIZE
+	};
+	for (uint32_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+	{
+		if (cases[i].start != 0)
+			hardFault_registerTaskStack(cases[i].start, cases[i].end);
+	}
+	for (uint32_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+	{
+		hostSim_fault_t fault = hostSim_makeFault(cases[i].copied / sizeof(uint32_t), cases[i].sp + cases[i].copied, EXC_RETURN_THREAD_PSP);
+		prvRun(cases[i].name, &fault, cases[i].copied - 8 * sizeof(uint32_t));
+	}
+	for (uint32_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+	{
+		if (cases[i].start != 0)
+			hardFault_unregisterTaskStack(cases[i].start);
+	}
+}
+#endif
+
+#if HARDFAULT_STACK_DMA
+#define CFSR_BFARVALID (1 << 15)
+
+/**
+ * the stack is copied by the CPU when the DMA fails or when a precise bus fault hit the peripheral space,
+ * where the DMA controller may be the cause. hostSim_dmaFail is only consumed by a transfer that was started.
+ */
+static void prvTestDmaFallback(void)
+{
+	static const struct {
+		const char* name;
+		uint32_t CFSR;
+		uint32_t BFAR;
+		bool dmaStarted;
+	} cases[] = {
+		{"dma failed", 0x400, 0, true},
+		{"dma bfar peripheral", CFSR_BFARVALID, 0x40020000, false},
+		{"dma bfar peripheral end", CFSR_BFARVALID, 0x5FFFFFFC, false},
+		{"dma bfar ram", CFSR_BFARVALID, 0x20001000, true},
+		{"dma bfar not valid", 0x400, 0x40020000, true},
+	};
+	for (uint32_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+	{
+		uint32_t words = 128;
+		hostSim_fault_t fault = hostSim_makeFault(words, MAIN_STACK_BASE, EXC_RETURN_THREAD_MSP);
+		/* unlike the previous dumps, so a copy that never happened leaves stale bytes in the slot */
+		for (uint32_t j = 8; j < words; j++)
+			hostSim_stack[j] ^= 0x5A5A0000 + i;
+		fault.SCB_registers.CFSR = cases[i].CFSR;
+		fault.SCB_registers.BFAR = cases[i].BFAR;
+		hostSim_dmaFail = true;
+		hostSim_result_t result = {0};
+		bool pass = hostSim_fault(&fault, &result) && result.valid && result.stackBytes == (words - 8) * sizeof(uint32_t) &&
+		            hostSim_dmaFail != cases[i].dmaStarted;
+		hostSim_dmaFail = false;
+		prvReport(cases[i].name, &result, pass);
+	}
+}
+#endif
+
+#if HARDFAULT_CAPTURE_FPU
+/**
+ * faults with an extended exception frame: S0-S15 and FPSCR come from the frame,
+ * or from the FPU when lazy stacking deferred them (LSPACT), which must then be cleared.
+ * S16-S31 always come from the FPU.
+ */
+static void prvTestFpu(void)
+{
+	static const struct {
+		const char* name;
+		bool lazyStacking;
+	} cases[] = {
+		{"fpu frame", false},
+		{"fpu lazy stacking", true},
+	};
+	for (uint32_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+	{
+		uint32_t words = 64;
+		hostSim_fault_t fault = hostSim_makeFault(words, MAIN_STACK_BASE, EXC_RETURN_THREAD_MSP_FPU);
+		for (uint32_t s = 0; s < 16; s++)
+			hostSim_stack[8 + s] = 0x3F800000 + s; // S0-S15 of the frame
+		hostSim_stack[24] = 0x03000000;            // FPSCR of the frame
+		for (uint32_t s = 0; s < 32; s++)
+			fault.fpuRegisters[s] = 0x40000000 + s;
+		fault.FPSCR = 0x0C000000;
+		fault.lazyStacking = cases[i].lazyStacking;
+
+		hostSim_result_t result = {0};
+		bool pass = hostSim_fault(&fault, &result) && result.valid && result.stackBytes == (words - 8) * sizeof(uint32_t) &&
+		            (result.flags & (DUMP_FLAG_FPU | DUMP_FLAG_FPU_HIGH)) == (DUMP_FLAG_FPU | DUMP_FLAG_FPU_HIGH) &&
+		            (result.FPCCR & HOSTSIM_FPCCR_LSPACT) == 0;
+		const uint32_t* low = cases[i].lazyStacking ? fault.fpuRegisters : &hostSim_stack[8];
+		uint32_t FPSCR = cases[i].lazyStacking ? fault.FPSCR : hostSim_stack[24];
+		pass = pass && memcmp(result.fpuRegisters, low, 16 * sizeof(uint32_t)) == 0 &&
+		       memcmp(&result.fpuRegisters[16], &fault.fpuRegisters[16], 16 * sizeof(uint32_t)) == 0 &&
+		       result.fpuRegisters[32] == FPSCR;
+		prvReport(cases[i].name, &result, pass);
+	}
+
+	/* a standard frame has no FPU state */
+	hostSim_fault_t fault = hostSim_makeFault(64, MAIN_STACK_BASE, EXC_RETURN_THREAD_MSP);
+	hostSim_result_t result = {0};
+	bool pass = hostSim_fault(&fault, &result) && result.valid && (result.flags & DUMP_FLAG_FPU) == 0;
+	prvReport("fpu standard frame", &result, pass);
+}
+#endif
+
+#if HARDFAULT_CAPTURE_BOTH_STACKS
+/**
+ * both stacks are saved as sections: the stack of the violating context from its sp and tagged active,
+ * the main stack of a task fault from its budget below the base, the PSP of a main stack fault only when it points into the RAM
+ */
+static void prvTestBothStacks(void)
+{
+	static const struct {
+		const char* name;
+		uint32_t words;
+		uint32_t excReturn;
+		uint32_t otherStack; // the PSP of a main stack fault
+		uint32_t sectionCount;
+	} cases[] = {
+		{"both msp and psp", 64, EXC_RETURN_THREAD_MSP, TASK_STACK_BASE - 256, 2},
+		{"both msp over budget", 512, EXC_RETURN_HANDLER_MSP, TASK_STACK_BASE - 256, 2},
+		{"both psp over budget", 256, EXC_RETURN_THREAD_PSP, 0, 2},
+		{"both psp missing", 64, EXC_RETURN_THREAD_MSP, 0, 1},
+		{"both psp misaligned", 64, EXC_RETURN_THREAD_MSP, TASK_STACK_BASE - 254, 1},
+		{"both psp below ram", 64, EXC_RETURN_THREAD_MSP, HOSTSIM_RAM_BASE - 0x100, 1},
+		{"both psp in dump region", 64, EXC_RETURN_THREAD_MSP, PROG_RAM_END + 0x100, 1},
+	};
+	for (uint32_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+	{
+		bool task = (cases[i].excReturn & EXC_RETURN_PROCESS_STACK) != 0;
+		uint32_t stackBase = task ? TASK_STACK_BASE : MAIN_STACK_BASE;
+		hostSim_fault_t fault = hostSim_makeFault(cases[i].words, stackBase, cases[i].excReturn);
+		fault.otherStack = cases[i].otherStack;
+		uint32_t sp = stackBase - cases[i].words * sizeof(uint32_t);
+		/* the task stacks are HARDFAULT_TASK_STACK_FIXED_SIZE from the sp */
+		uint32_t active = task ? 1024 - 32 : (cases[i].words - 8) * sizeof(uint32_t);
+
+		dump_section_t expected[2];
+		if (task)
+		{
+			expected[0] = (dump_section_t){DUMP_SECTION_MSP, MAIN_STACK_BASE - HARDFAULT_MSP_SECTION_BUDGET, HARDFAULT_MSP_SECTION_BUDGET};
+			expected[1] = (dump_section_t){DUMP_SECTION_PSP | DUMP_SECTION_ACTIVE, sp + 32,
+			                               active < HARDFAULT_PSP_SECTION_BUDGET ? active : HARDFAULT_PSP_SECTION_BUDGET};
+		}
+		else
+		{
+			expected[0] = (dump_section_t){DUMP_SECTION_MSP | DUMP_SECTION_ACTIVE, sp + 32,
+			                               active < HARDFAULT_MSP_SECTION_BUDGET ? active : HARDFAULT_MSP_SECTION_BUDGET};
+			expected[1] = (dump_section_t){DUMP_SECTION_PSP, cases[i].otherStack, HARDFAULT_PSP_SECTION_BUDGET < 1024 ? HARDFAULT_PSP_SECTION_BUDGET : 1024};
+		}
+		hostSim_result_t result = {0};
+		bool pass = hostSim_fault(&fault, &result) && result.valid && (result.flags & DUMP_FLAG_SECTIONS) &&
+		            prvCheckSections(&result, expected, cases[i].sectionCount);
+		prvReport(cases[i].name, &result, pass);
+	}
+}
+#endif
+
+#if HARDFAULT_STACK_TRUNCATION == 1 // HARDFAULT_TRUNCATE_COMPACT
+#define COMPACT_CODE_START (HOSTSIM_RAM_BASE + 0xC000)
+#define COMPACT_CODE_SIZE  0x1000
+
+/**
+ * a stack larger than the slot: the top of the stack is saved as is, then only the return addresses of the rest,
+ * the raw part is cut to keep HARDFAULT_COMPACT_ADDRESS_BYTES for them
+ */
+static void prvTestCompactStack(void)
+{
+	uint16_t* code = (uint16_t*)(uintptr_t)COMPACT_CODE_START;
+	memset(code, 0, COMPACT_CODE_SIZE);
+	uint32_t calls[6];
+	for (uint32_t i = 0; i < sizeof(calls) / sizeof(calls[0]); i++)
+	{
+		uint32_t site = COMPACT_CODE_START + 0x100 + i * 0x40;
+		code[(site - COMPACT_CODE_START) / 2] = 0xF000;     // BL, first halfword
+		code[(site - COMPACT_CODE_START) / 2 + 1] = 0xF800; // BL, second halfword
+		calls[i] = (site + 4) | 1;
+	}
+
+	const uint32_t words = 4096;
+	uint32_t space = hostSim_storage.slotSize - hostSim_storage.slotHeaderSize - sizeof(core_dump_t);
+	uint32_t rawLength = (space - sizeof(uint32_t) - HARDFAULT_COMPACT_ADDRESS_BYTES) & ~3u;
+	uint32_t rawWords = rawLength / sizeof(uint32_t);
+	hostSim_fault_t fault = hostSim_makeFault(words, MAIN_STACK_BASE, EXC_RETURN_THREAD_MSP);
+	fault.codeStart = COMPACT_CODE_START;
+	fault.codeEnd = COMPACT_CODE_START + COMPACT_CODE_SIZE;
+	hostSim_stack[8 + rawWords - 1] = calls[0]; // in the raw part, saved as is
+	for (uint32_t i = 1; i < sizeof(calls) / sizeof(calls[0]); i++)
+		hostSim_stack[8 + rawWords + (i - 1) * 150] = calls[i];
+
+	hostSim_result_t result = {0};
+	bool pass = hostSim_fault(&fault, &result) && result.valid && (result.flags & DUMP_FLAG_STACK_COMPACT) &&
+	            result.contextStackLength == sizeof(uint32_t) + rawLength + (sizeof(calls) / sizeof(calls[0]) - 1) * sizeof(uint32_t);
+	uint32_t savedRawLength = 0;
+	if (pass)
+		memcpy(&savedRawLength, result.contextStack, sizeof(savedRawLength));
+	pass = pass && savedRawLength == rawLength && result.stackBytes == rawLength;
+	for (uint32_t i = 1; pass && i < sizeof(calls) / sizeof(calls[0]); i++)
+	{
+		uint32_t address;
+		memcpy(&address, result.contextStack + sizeof(uint32_t) + rawLength + (i - 1) * sizeof(uint32_t), sizeof(address));
+		pass = address == (calls[i] & ~1u);
+	}
+	prvReport("compact stack", &result, pass);
+}
+#endif
+
+#if HARDFAULT_STACK_TRUNCATION == 2 // HARDFAULT_TRUNCATE_SPLIT
+/**
+ * a stack larger than the slot: a window from the sp and a tail of HARDFAULT_SPLIT_TAIL_BYTES ending at the base of the stack
+ */
+static void prvTestSplitStack(void)
+{
+	static const struct {
+		const char* name;
+		uint32_t words;
+		uint32_t excReturn;
+		uint32_t stackBase;
+	} cases[] = {
+		{"split main stack", 4096, EXC_RETURN_THREAD_MSP, MAIN_STACK_BASE},
+		{"split handler stack", 8192, EXC_RETURN_HANDLER_MSP, MAIN_STACK_BASE},
+	};
+	for (uint32_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+	{
+		hostSim_fault_t fault = hostSim_makeFault(cases[i].words, cases[i].stackBase, cases[i].excReturn);
+		uint32_t sp = cases[i].stackBase - cases[i].words * sizeof(uint32_t);
+		uint32_t space = hostSim_storage.slotSize - hostSim_storage.slotHeaderSize - sizeof(core_dump_t);
+		uint32_t windows = (space - 2 * sizeof(stack_window_t)) & ~3u;
+		stack_window_t expected[2] = {
+			{sp + 32, windows - HARDFAULT_SPLIT_TAIL_BYTES},
+			{cases[i].stackBase - HARDFAULT_SPLIT_TAIL_BYTES, HARDFAULT_SPLIT_TAIL_BYTES},
+		};
+
+		hostSim_result_t result = {0};
+		bool pass = hostSim_fault(&fault, &result) && result.valid && (result.flags & DUMP_FLAG_STACK_SPLIT) &&
+		            result.stackBytes == windows &&
+		            result.contextStackLength == 2 * sizeof(stack_window_t) + windows;
+		stack_window_t window[2] = {{0, 0}, {0, 0}};
+		if (pass)
+		{
+			memcpy(&window[0], result.contextStack, sizeof(window[0]));
+			memcpy(&window[1], result.contextStack + sizeof(window[0]) + window[0].length, sizeof(window[1]));
+		}
+		pass = pass && window[0].address == expected[0].address && window[0].length == expected[0].length &&
+		       window[1].address == expected[1].address && window[1].length == expected[1].length &&
+		       window[1].address + window[1].length == cases[i].stackBase;
+		prvReport(cases[i].name, &result, pass);
+	}
+}
+#endif
+
+#if HARDFAULT_CAPTURE_REGIONS
+#define REGIONS_ADDRESS (HOSTSIM_RAM_BASE + 0xD000) // the registered regions must be on the simulated RAM
+
+/**
+ * the registered regions are saved by priority, ties in the order they were registered, the last one cut to HARDFAULT_REGION_BUDGET
+ */
+static void prvTestRegions(void)
+{
+	static const struct {
+		uint32_t offset;
+		uint32_t length;
+		uint32_t priority;
+		uint32_t tag;
+	} regions[] = {
+		{0x000, 16, 1, 0xA},
+		{0x100, 16, 3, 0xB},
+		{0x200, 16, 1, 0xC},
+		{0x300, 40, 2, 0xD},
+		{0x400, 16, 4, 0xE}, // the table is full
+	};
+	uint8_t* ram = (uint8_t*)(uintptr_t)REGIONS_ADDRESS;
+	for (uint32_t i = 0; i < 0x500; i++)
+		ram[i] = (uint8_t)(i * 7 + 3);
+	bool registered = true;
+	for (uint32_t i = 0; i < sizeof(regions) / sizeof(regions[0]); i++)
+	{
+		bool expected = i < HARDFAULT_MAX_REGIONS;
+		registered = registered && hardFault_registerRegion(ram + regions[i].offset, regions[i].length, regions[i].priority, regions[i].tag) == expected;
+	}
+
+#if HARDFAULT_REGION_BUDGET == 128
+	/* 4 + (12 + 16) + (12 + 40) + (12 + 16) + (12 + 4) */
+	static const dump_section_t expected[] = {
+		{0xB, REGIONS_ADDRESS + 0x100, 16},
+		{0xD, REGIONS_ADDRESS + 0x300, 40},
+		{0xA, REGIONS_ADDRESS + 0x000, 16},
+		{0xC, REGIONS_ADDRESS + 0x200, 4},
+	};
+	const uint32_t count = sizeof(expected) / sizeof(expected[0]);
+#else
+	/* no room for a single dump_section_t, the table is empty */
+	static const dump_section_t expected[1];
+	const uint32_t count = 0;
+#endif
+
+	hostSim_fault_t fault = hostSim_makeFault(64, MAIN_STACK_BASE, EXC_RETURN_THREAD_MSP);
+	hostSim_result_t result = {0};
+	bool pass = registered && hostSim_fault(&fault, &result) && result.valid && (result.flags & DUMP_FLAG_REGIONS) &&
+	            result.stackBytes == (64 - 8) * sizeof(uint32_t);
+
+	hardFault_dumpIterator_t iterator;
+	hardFault_dumpView_t view;
+	hardFault_dumpIteratorInit(&iterator);
+	pass = pass && hardFault_dumpIteratorNextView(&iterator, &view) && view.regions != NULL;
+	uint32_t savedCount = 0;
+	if (pass)
+		memcpy(&savedCount, view.regions, sizeof(savedCount));
+	pass = pass && savedCount == count;
+	const uint8_t* data = view.regions + sizeof(uint32_t) + count * sizeof(dump_section_t);
+	for (uint32_t i = 0; pass && i < count; i++)
+	{
+		dump_section_t section;
+		memcpy(&section, view.regions + sizeof(uint32_t) + i * sizeof(dump_section_t), sizeof(section));
+		pass = section.tag == expected[i].tag && section.address == expected[i].address && section.length == expected[i].length &&
+		       memcmp(data, (const void*)(uintptr_t)expected[i].address, expected[i].length) == 0;
+		data += section.length;
+	}
+	pass = pass && data == view.regions + view.regionsLength;
+	prvReport(count ? "regions" : "regions over budget", &result, pass);
+}
+#endif
+
+#if HARDFAULT_PHASE_TIMING
+/**
+ * the header holds the cycles of each phase of the capture, which add up to the simulated cycles before the header was written
+ */
+static void prvTestPhaseTiming(void)
+{
+	hostSim_fault_t fault = hostSim_makeFault(256, MAIN_STACK_BASE, EXC_RETURN_THREAD_MSP);
+	hostSim_result_t result = {0};
+	bool pass = hostSim_fault(&fault, &result) && result.valid && (result.flags & DUMP_FLAG_PHASE_TIMING);
+
+	hardFault_dumpIterator_t iterator;
+	hardFault_dumpView_t view;
+	hardFault_dumpIteratorInit(&iterator);
+	pass = pass && hardFault_dumpIteratorNextView(&iterator, &view);
+	uint32_t sum = 0;
+	for (uint32_t i = 0; pass && i < DUMP_PHASE_COUNT; i++)
+		sum += view.header->phaseCycles[i];
+	pass = pass && view.header->phaseCycles[DUMP_PHASE_ERASE] > 0 && view.header->phaseCycles[DUMP_PHASE_STACK] > 0 &&
+	       result.headerCycles > 0 && sum == result.cycles - result.headerCycles;
+	prvReport("phase timing", &result, pass);
+}
+#endif
+
+#if HARDFAULT_BACKTRACE == 1 // HARDFAULT_BACKTRACE_EHABI
+/**
+ * A hand assembled .ARM.exidx and .ARM.extab, loaded on the simulated RAM at the addresses the linker would give them.
+ * Each function has an entry in .ARM.exidx, with its unwind instructions inline or in .ARM.extab
+ */
+#define EHABI_EXIDX_ADDRESS (HOSTSIM_RAM_BASE + 0xC000)
+#define EHABI_EXTAB_ADDRESS (HOSTSIM_RAM_BASE + 0xC100)
+#define EHABI_PERSONALITY   0x08000100 // the personality routine of the generic entry, never called
+
+#define FUNCTION_SU16       0x08001000 // su16 inline: pop {r4, lr}
+#define FUNCTION_LU16       0x08002000 // lu16 with an extra word: add sp, #12; pop {r7, lr}
+#define FUNCTION_GENERIC    0x08003000 // generic personality: add sp, #1032 (0xB2 with a two byte uleb128); vpop {d8-d9}; pop {r4, lr}
+#define FUNCTION_OUT_OF_STACK 0x08004000 // su16: add sp, #256; pop {r4, lr}, its frame is larger than what's left of the stack
+#define FUNCTION_CANTUNWIND 0x08005000
+
+static uint32_t prvPrel31(uint32_t at, uint32_t target)
+{
+	return (target - at) & 0x7FFFFFFF;
+}
+
+static void prvLoadEhabiTables(void)
+{
+	uint32_t* extab = (uint32_t*)(uintptr_t)EHABI_EXTAB_ADDRESS;
+	extab[0] = 0x81010284; // lu16, 1 extra word: vsp += 12, pop {r7, lr} (0x84 0x08)
+	extab[1] = 0x08B0B0B0;
+	extab[2] = prvPrel31(EHABI_EXTAB_ADDRESS + 8, EHABI_PERSONALITY);
+	extab[3] = 0x01B28101; // 1 extra word: vsp += 0x204 + (129 << 2)
+	extab[4] = 0xD1A8B0B0; // pop {d8-d9}, pop {r4, lr}
+
+	static const struct {
+		uint32_t function;
+		uint32_t extab;    // the offset of the function's .ARM.extab entry, or UINT32_MAX for an inline entry
+		uint32_t inline_;
+	} entries[] = {
+		{FUNCTION_SU16, UINT32_MAX, 0x80A8B0B0},
+		{FUNCTION_LU16, 0, 0},
+		{FUNCTION_GENERIC, 8, 0},
+		{FUNCTION_OUT_OF_STACK, UINT32_MAX, 0x803FA8B0},
+		{FUNCTION_CANTUNWIND, UINT32_MAX, 0x00000001},
+	};
+	uint32_t* exidx = (uint32_t*)(uintptr_t)EHABI_EXIDX_ADDRESS;
+	for (uint32_t i = 0; i < sizeof(entries) / sizeof(entries[0]); i++)
+	{
+		uint32_t address = EHABI_EXIDX_ADDRESS + i * 8;
+		exidx[2 * i] = prvPrel31(address, entries[i].function);
+		exidx[2 * i + 1] = entries[i].extab == UINT32_MAX ? entries[i].inline_ : prvPrel31(address + 4, EHABI_EXTAB_ADDRESS + entries[i].extab);
+	}
+}
+
+/**
+ * unwind the fixture: each function of the chain is unwound by a different kind of entry,
+ * the unwinding must stop at a frame that leaves the stack and at a function that can't be unwound
+ */
+static void prvTestEhabiBacktrace(void)
+{
+	prvLoadEhabiTables();
+
+	/* SU16 <- LU16 <- GENERIC <- OUT_OF_STACK */
+	hostSim_fault_t fault = hostSim_makeFault(287, MAIN_STACK_BASE, EXC_RETURN_THREAD_MSP);
+	fault.exidxStart = EHABI_EXIDX_ADDRESS;
+	fault.exidxEnd = EHABI_EXIDX_ADDRESS + 5 * 8;
+	hostSim_stack[6] = FUNCTION_SU16 + 0x10;                // PC of the fault
+	hostSim_stack[8 + 1] = (FUNCTION_LU16 + 0x10) | 1;       // after r4
+	hostSim_stack[10 + 3 + 1] = (FUNCTION_GENERIC + 0x20) | 1; // after 3 words and r7
+	hostSim_stack[15 + 262 + 1] = (FUNCTION_OUT_OF_STACK + 0x30) | 1; // after 1032 bytes, d8-d9 and r4
+	/* 8 words left, the frame of OUT_OF_STACK needs 66 */
+	static const uint32_t chain[] = {FUNCTION_SU16 + 0x10, FUNCTION_LU16 + 0x10, FUNCTION_GENERIC + 0x20, FUNCTION_OUT_OF_STACK + 0x30};
+	hostSim_result_t result = {0};
+	bool pass = hostSim_fault(&fault, &result) && result.valid && result.backtraceDepth == 4 &&
+	            memcmp(result.backtrace, chain, sizeof(chain)) == 0;
+	prvReport("ehabi chain", &result, pass);
+
+	/* SU16 <- CANTUNWIND */
+	fault = hostSim_makeFault(18, MAIN_STACK_BASE, EXC_RETURN_THREAD_MSP);
+	fault.exidxStart = EHABI_EXIDX_ADDRESS;
+	fault.exidxEnd = EHABI_EXIDX_ADDRESS + 5 * 8;
+	hostSim_stack[6] = FUNCTION_SU16 + 0x10;
+	hostSim_stack[8 + 1] = (FUNCTION_CANTUNWIND + 0x10) | 1;
+	static const uint32_t cantUnwind[] = {FUNCTION_SU16 + 0x10, FUNCTION_CANTUNWIND + 0x10};
+	result = (hostSim_result_t){0};
+	pass = hostSim_fault(&fault, &result) && result.valid && result.backtraceDepth == 2 &&
+	       memcmp(result.backtrace, cantUnwind, sizeof(cantUnwind)) == 0;
+	prvReport("ehabi cantunwind", &result, pass);
+}
+#endif
+
+#define CHUNK_SIZE 256
+
+/**
+ * read the newest dump in chunks of CHUNK_SIZE, the CRC must not pass before the last chunk
+ * span - read with hardFault_dumpCursorSpan instead of copying
+ * return - the bytes read, 0 if the CRC passed early
+ */
+static uint32_t prvReadChunks(hardFault_dumpCursor_t* cursor, uint8_t* dump, uint32_t dumpSize, bool span)
+{
+	hardFault_dumpIterator_t iterator;
+	hardFault_dumpIteratorInit(&iterator);
+	if (!hardFault_dumpIteratorNextCursor(&iterator, cursor))
+		return 0;
+	uint32_t length = 0;
+	while (length < iterator.length)
+	{
+		uint8_t buffer[CHUNK_SIZE];
+		const void* data = buffer;
+		uint32_t chunk;
+#if !defined(HARDFAULT_STORAGE_BACKEND) || HARDFAULT_STORAGE_BACKEND <= 1 // HARDFAULT_STORAGE_MEMORY_MAPPED: RAM, INTERNAL_FLASH
+		if (span)
+			data = hardFault_dumpCursorSpan(cursor, sizeof(buffer), &chunk);
+		else
+#else
+		(void)span;
+#endif
+		chunk = hardFault_dumpCursorRead(cursor, buffer, sizeof(buffer));
+		if (chunk == 0 || length + chunk > dumpSize)
+			return 0;
+		memcpy(dump + length, data, chunk);
+		length += chunk;
+		if (length < iterator.length && hardFault_dumpCursorValid(cursor))
+			return 0;
+	}
+	return length;
+}
+
+/**
+ * stream the dump out in chunks smaller than the dump: the chunks must reassemble the dump,
+ * the CRC must pass only once the last chunk is read, and fail when a byte of the storage changed
+ */
+static void prvTestChunkedRead(void)
+{
+	static uint8_t whole[HOSTSIM_RAM_SIZE];
+	static uint8_t chunked[HOSTSIM_RAM_SIZE];
+	uint32_t words = 300;
+	hostSim_fault_t fault = hostSim_makeFault(words, MAIN_STACK_BASE, EXC_RETURN_THREAD_MSP);
+	hostSim_result_t result = {0};
+	bool pass = hostSim_fault(&fault, &result) && result.valid;
+
+	hardFault_dumpIterator_t iterator;
+	hardFault_dumpCursor_t cursor;
+	hardFault_dumpIteratorInit(&iterator);
+	pass = pass && hardFault_dumpIteratorNextCursor(&iterator, &cursor) && iterator.length > 2 * CHUNK_SIZE &&
+	       hardFault_dumpCursorRead(&cursor, whole, sizeof(whole)) == iterator.length && hardFault_dumpCursorValid(&cursor) &&
+	       memcmp(&((const core_dump_t*)whole)->core_registers, hostSim_stack, sizeof(core_registers_t)) == 0;
+	uint32_t length = iterator.length;
+
+	pass = pass && prvReadChunks(&cursor, chunked, sizeof(chunked), false) == length && hardFault_dumpCursorValid(&cursor) &&
+	       memcmp(chunked, whole, length) == 0;
+	prvReport("chunked read", &result, pass);
+
+#if !defined(HARDFAULT_STORAGE_BACKEND) || HARDFAULT_STORAGE_BACKEND <= 1
+	memset(chunked, 0, sizeof(chunked));
+	pass = pass && prvReadChunks(&cursor, chunked, sizeof(chunked), true) == length && hardFault_dumpCursorValid(&cursor) &&
+	       memcmp(chunked, whole, length) == 0;
+	prvReport("chunked span", &result, pass);
+#endif
+
+	/* a byte of the stored dump changes, past the first chunk */
+	uint8_t* corrupted = NULL;
+	if (pass)
+	{
+		hardFault_dumpIteratorInit(&iterator);
+		hardFault_dumpIteratorNextCursor(&iterator, &cursor);
+		corrupted = &hostSim_storage.data[cursor.address - hostSim_storage.address + CHUNK_SIZE + 17];
+		*corrupted ^= 0x10;
+	}
+	pass = pass && prvReadChunks(&cursor, chunked, sizeof(chunked), false) == length && !hardFault_dumpCursorValid(&cursor);
+	if (corrupted != NULL)
+		*corrupted ^= 0x10;
+	prvReport("chunked corrupted", &result, pass);
+}
+
+/**
+ * the sequence numbers of the saved dumps that pass their CRC, newest first
+ * return - the number of dumps
+ */
+static uint32_t prvSavedSequences(uint32_t* sequences, uint32_t maxCount)
+{
+	hardFault_dumpIterator_t iterator;
+	core_dump_t dump;
+	uint32_t count = 0;
+	hardFault_dumpIteratorInit(&iterator);
+	while (count < maxCount && hardFault_dumpIteratorNext(&iterator, &dump, sizeof(dump)))
+		sequences[count++] = iterator.sequence;
+	return count;
+}
+
+/**
+ * a slot damaged by a torn write or by the storage: after a reboot, hardFault_init and the iterator must skip that slot only
+ */
+static void prvTestCorruptedSlots(void)
+{
+	static const struct {
+		const char* name;
+		uint32_t age;    // the damaged slot holds the dump of the newest sequence - age
+		bool body;       // the damaged byte is in the dump after the header, or in the header
+		uint32_t offset; // the damaged byte, UINT32_MAX to zero the whole slot
+	} cases[] = {
+		{"corrupted body", 1, true, offsetof(core_dump_t, extended_registers)},
+		{"corrupted header", 0, false, offsetof(dump_header_t, flags)},
+		{"zeroed slot", 2, false, UINT32_MAX},
+	};
+	static uint8_t saved[HOSTSIM_RAM_SIZE];
+	uint32_t slotCount = hostSim_storage.slotCount;
+	hostSim_result_t result = {0};
+	bool captured = true;
+	for (uint32_t i = 0; i < slotCount; i++)
+	{
+		hostSim_fault_t fault = hostSim_makeFault(64, MAIN_STACK_BASE, EXC_RETURN_THREAD_MSP);
+		captured = captured && hostSim_fault(&fault, &result) && result.valid;
+	}
+	uint32_t sequences[8] = {0};
+	captured = captured && slotCount <= sizeof(sequences) / sizeof(sequences[0]) &&
+	           prvSavedSequences(sequences, slotCount) == slotCount && hostSim_storage.size <= sizeof(saved);
+	uint32_t newest = sequences[0];
+	if (captured)
+		memcpy(saved, hostSim_storage.data, hostSim_storage.size);
+
+	for (uint32_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+	{
+		bool pass = captured;
+		if (pass)
+		{
+			uint8_t* slot = hostSim_storage.data + (newest - cases[i].age) % slotCount * hostSim_storage.slotSize;
+			if (cases[i].offset == UINT32_MAX)
+				memset(slot, 0, hostSim_storage.slotSize);
+			else
+				slot[(cases[i].body ? hostSim_storage.slotHeaderSize : 0) + cases[i].offset] ^= 0x04;
+			hardFault_init();
+
+			uint32_t count = prvSavedSequences(sequences, slotCount);
+			uint32_t expected = cases[i].age == 0 ? newest - 1 : newest;
+			pass = count == slotCount - 1;
+			for (uint32_t j = 0; pass && j < count; j++, expected--)
+			{
+				if (expected == newest - cases[i].age)
+					expected--;
+				pass = sequences[j] == expected;
+			}
+			memcpy(hostSim_storage.data, saved, hostSim_storage.size);
+			hardFault_init();
+		}
+		prvReport(cases[i].name, &result, pass);
+	}
+}
+
+/**
+ * more faults than slots: the oldest dumps are replaced and the iterator returns the last HARDFAULT_SLOT_COUNT, newest first.
+ * Then the same across the wrap of the sequence number, from a dump moved to sequence 0xFFFFFFFE.
+ */
+static void prvTestSequence(void)
+{
+	uint32_t slotCount = hostSim_storage.slotCount;
+	uint32_t sequences[8] = {0};
+	hostSim_result_t result = {0};
+	bool pass = slotCount <= sizeof(sequences) / sizeof(sequences[0]) && prvSavedSequences(sequences, 1) == 1;
+	uint32_t first = sequences[0] + 1;
+	for (uint32_t i = 0; i < slotCount + 1; i++)
+	{
+		hostSim_fault_t fault = hostSim_makeFault(64, MAIN_STACK_BASE, EXC_RETURN_THREAD_MSP);
+		pass = pass && hostSim_fault(&fault, &result) && result.valid;
+	}
+	pass = pass && prvSavedSequences(sequences, slotCount + 1) == slotCount;
+	for (uint32_t i = 0; pass && i < slotCount; i++)
+		pass = sequences[i] == first + slotCount - i;
+	prvReport("sequence", &result, pass);
+
+	/* the newest dump becomes the only one, with sequence 0xFFFFFFFE */
+	uint32_t wrap = 0xFFFFFFFE;
+	static uint8_t slot[HOSTSIM_RAM_SIZE];
+	pass = pass && hostSim_storage.slotSize <= sizeof(slot);
+	if (pass)
+	{
+		memcpy(slot, hostSim_storage.data + sequences[0] % slotCount * hostSim_storage.slotSize, hostSim_storage.slotSize);
+		dump_header_t header;
+		memcpy(&header, slot, sizeof(header));
+		header.sequence = wrap;
+		header.headerCrc = hostSim_crc32(0, &header, offsetof(dump_header_t, headerCrc));
+		memcpy(slot, &header, sizeof(header));
+		hardFault_eraseSavedData();
+		memcpy(hostSim_storage.data + wrap % slotCount * hostSim_storage.slotSize, slot, hostSim_storage.slotSize);
+		hardFault_init();
+	}
+	for (uint32_t i = 0; i < slotCount - 1; i++)
+	{
+		hostSim_fault_t fault = hostSim_makeFault(64, MAIN_STACK_BASE, EXC_RETURN_THREAD_MSP);
+		pass = pass && hostSim_fault(&fault, &result) && result.valid;
+	}
+	pass = pass && prvSavedSequences(sequences, slotCount + 1) == slotCount;
+	for (uint32_t i = 0; pass && i < slotCount; i++)
+		pass = sequences[i] == wrap + slotCount - 1 - i;
+	prvReport("sequence wrap", &result, pass);
+}
+
+/**
+ * a stack larger than the slot, the dump keeps what fits
+ */
+static void prvTestDeepStack(void)
+{
+	uint32_t words = HOSTSIM_STACK_WORDS;
+	hostSim_fault_t fault = hostSim_makeFault(words, MAIN_STACK_BASE, EXC_RETURN_THREAD_MSP);
+	hostSim_result_t result = {0};
+	bool pass = hostSim_fault(&fault, &result) && result.valid &&
+	            result.stackBytes > 0 && result.stackBytes < (words - 8) * sizeof(uint32_t);
+	prvReport("deep stack", &result, pass);
+}
+
+int main(int argc, char** argv)
+{
+	if (argc > 1)
+		config = argv[1];
+	if (!hostSim_mapRam())
+	{
+		fprintf(stderr, "can't map the simulated RAM at 0x%08x\n", HOSTSIM_RAM_BASE);
+		return 1;
+	}
+	printf("%-8s %-24s %10s %10s %8s %-5s\n", "config", "scenario", "cycles", "ns", "bytes", "valid");
+
+	prvTestMainStack();
+	prvTestTaskStack();
+	prvTestDeepStack();
+	prvTestExcReturn();
+	prvTestMainStackEqualsPsp();
+	prvTestStackingError();
+	prvTestChunkedRead();
+	prvTestCorruptedSlots();
+	prvTestSequence();
+#if HARDFAULT_TASK_STACK_MODE == 1
+	prvTestRegisteredTaskStacks();
+#endif
+#if HARDFAULT_STACK_DMA
+	prvTestDmaFallback();
+#endif
+#if HARDFAULT_CAPTURE_FPU
+	prvTestFpu();
+#endif
+#if HARDFAULT_BACKTRACE == 1
+	prvTestEhabiBacktrace();
+#endif
+#if HARDFAULT_CAPTURE_BOTH_STACKS
+	prvTestBothStacks();
+#endif
+#if HARDFAULT_STACK_TRUNCATION == 1
+	prvTestCompactStack();
+#elif HARDFAULT_STACK_TRUNCATION == 2
+	prvTestSplitStack();
+#endif
+#if HARDFAULT_CAPTURE_REGIONS
+	prvTestRegions();
+#endif
+#if HARDFAULT_PHASE_TIMING
+	prvTestPhaseTiming();
+#endif
+
+	return failures ? 1 : 0;
+}